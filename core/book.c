@@ -29,6 +29,7 @@ void init_book(char *bookfile)
 {
     struct stat statbuf;
     FILE *fp;
+    bookrec rec;
     size_t size;
     int ret;
 
@@ -45,7 +46,7 @@ void init_book(char *bookfile)
         printf("init_book: can't open book file %s\n", bookfile);
         return;
     }
-    book_size = statbuf.st_size/sizeof(bitboard);
+    book_size = statbuf.st_size/sizeof(bookrec);
     if (book_size == 0)
     {
         printf("init_book: %s is an empty book file\n", bookfile);
@@ -64,7 +65,20 @@ void init_book(char *bookfile)
         book_size = 0;
         return;
     }
-    size = fread(book_positions, sizeof(bitboard), book_size, fp);
+    for (size = 0; size < book_size; size++)
+    {
+        if (fread(&rec, sizeof rec, 1, fp) != 1)
+        {
+            break; /* out of for loop */
+        }
+        book_positions[size].white = rec.white;
+        book_positions[size].black = rec.black;
+        book_positions[size].kings = rec.kings;
+        book_positions[size].side = rec.side;
+        book_positions[size].moveinfo = rec.moveinfo;
+        book_positions[size].parent = NULL;
+        hash_board(&book_positions[size]);
+    }
     fclose(fp);
     if (size != book_size)
     {
@@ -77,6 +91,32 @@ void init_book(char *bookfile)
     return;
 }
 
+/* write book positions to file */
+/* fp -> opened book file */
+/* positions -> the book positions, sorted */
+/* count = nr. of positions */
+/* returns: nr. of positions written */
+size_t write_book(FILE *fp, bitboard *positions, size_t count)
+{
+    bookrec rec;
+    size_t n;
+
+    memset(&rec, 0, sizeof rec);
+    for (n = 0; n < count; n++)
+    {
+        rec.white = positions[n].white;
+        rec.black = positions[n].black;
+        rec.kings = positions[n].kings;
+        rec.side = positions[n].side;
+        rec.moveinfo = positions[n].moveinfo;
+        if (fwrite(&rec, sizeof rec, 1, fp) != 1)
+        {
+            break; /* out of for loop */
+        }
+    }
+    return n;
+}
+
 /* determine "weight" of move strength annotation */
 /* annot = move strength value of considered move */
 /* n = number of book moves to choose from */
@@ -17,8 +17,18 @@
     along with Moby Dam.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+typedef struct {        /* book file record */
+    u64 white;          /* bit positions of white pieces */
+    u64 black;          /* bit positions of black pieces */
+    u64 kings;          /* bit positions of white and black kings */
+    u32 side;           /* side to move, W or B */
+    u32 moveinfo;       /* move strength annotation */
+    u64 unused;         /* zero; was the parent ptr of old bitboards */
+} bookrec;
+
 extern bitboard *book_positions;
 extern size_t book_size;
 
 extern void init_book(char *bookfile);
+extern size_t write_book(FILE *fp, bitboard *positions, size_t count);
 extern bool get_bookmove(movelist *listptr);
@@ -29,6 +29,7 @@
 /* evaluate breakthrough to promotion */
 /* bb -> current board */
 /* returns: evaluation score for white */
+HOTPATH
 s32 eval_break(bitboard *bb)
 {
     u64 wm, bm;
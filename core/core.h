@@ -43,12 +43,16 @@
 #ifdef _WIN32
 #define IPV6STRICT
 #include <winsock2.h>
+typedef HANDLE thrd;
 #else
 #include <netdb.h>
 #include <netinet/in.h> 
 #include <sys/socket.h> 
 #include <sys/mman.h>
+#include <sys/syscall.h>
+#include <pthread.h>
 typedef int SOCKET;
+typedef pthread_t thrd;
 #define INVALID_SOCKET -1
 #define SOCKET_ERROR -1
 #define sockerror perror
@@ -253,11 +257,51 @@ __inline static u32 __builtin_clzll(u64 x) {u32 i; _BitScanReverse64(&i, x); ret
 #define strcasecmp _stricmp 
 #define strncasecmp _strnicmp 
 #define usleep(x) Sleep((x)/1000)
+#define THREADLOCAL __declspec(thread)
+#define FORCEINLINE __forceinline
+/* atomics on u32 values shared between threads */
+#define atomic_cas32(p,o,n) \
+    (InterlockedCompareExchange((volatile LONG *)(p), (LONG)(n), (LONG)(o)) \
+     == (LONG)(o))
+#define atomic_add32(p,v) \
+    ((u32)InterlockedAdd((volatile LONG *)(p), (LONG)(v)))
+#define atomic_tas32(p) InterlockedExchange((volatile LONG *)(p), 1)
+#define atomic_clear32(p) InterlockedExchange((volatile LONG *)(p), 0)
+/* publishing data to other threads; p must point to a volatile, as */
+/* volatile reads and writes have acquire and release semantics */
+/* (/volatile:ms, the default for x64) */
+#define load_acquire(p) (*(p))
+#define store_release(p,v) (*(p) = (v))
 #else
 /* POPCNT instruction is supported since the Intel "Nehalem" (Core i) */
 /* and AMD "Barcelona" (K10) processors. */
-/* Using GCC 4 intrinsic; compile also with -mpopcnt */
+/* Using GCC 4 intrinsic; the hot kernels use the instruction when the */
+/* cpu has it (see HOTPATH), elsewhere it's a library call */
 #define popcount __builtin_popcountll
+#define THREADLOCAL __thread
+#define FORCEINLINE __inline__ __attribute__((always_inline))
+/* atomics on u32 values shared between threads (GCC 4 builtins) */
+#define atomic_cas32(p,o,n) __sync_bool_compare_and_swap((p), (o), (n))
+#define atomic_add32(p,v) __sync_add_and_fetch((p), (v))
+#define atomic_tas32(p) __sync_lock_test_and_set((p), 1)
+#define atomic_clear32(p) __sync_lock_release(p)
+/* publishing data to other threads */
+#define load_acquire(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define store_release(p,v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#endif
+
+/* hot kernels are compiled for several instruction set levels, and */
+/* the dynamic loader picks the best one for the cpu (GCC ifunc); */
+/* calls between them stay within the same level; see cpu_variant */
+/* (not when compiling for a known cpu, e.g. with -mpopcnt or -march, */
+/* and not on windows, which has no ifunc, nor with MSVC) */
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(_WIN32) && \
+    !defined(__CYGWIN__) && !defined(__POPCNT__)
+#define HOTCLONES
+#define HOTPATH __attribute__((target_clones("arch=x86-64-v3", "popcnt", \
+                                             "default")))
+#else
+#define HOTPATH
 #endif
 
 #ifndef FALSE
@@ -21,13 +21,17 @@
 
 #include "core.h"
 
-u64 end_acc[7];                  /* access statistics */
+THREADLOCAL u64 end_acc[7];      /* access statistics */
+THREADLOCAL u64 end_blk[2];      /* wdl block cache statistics */
+THREADLOCAL wdlcache *end_cache; /* wdl block cache of this thread */
+THREADLOCAL u64 end_probes[ENDFILES]; /* wdl probes per db file */
 endhf *end_ref[EF*EF*EF*EF];     /* references to endgame file info */
 u32 combi_array[51][8];          /* combination lookup table */
 char enddb_dirs[PATH_MAX];       /* directory/ies of database files */
+volatile int end_lock;           /* taken while opening a file */
 
 /* endgame files, with size, piece count, table index, CRC, name */
-endhf end_set[] = {
+endhf end_set[ENDFILES] = {
   {    2500, 2, -1, 0xd2d8, "OvO.bin" },
   {    2500, 2, -1, 0x6915, "XvO.bin" },
   {    2500, 2, -1, 0xb1a5, "OvX.bin" },
@@ -226,7 +230,123 @@ char end_amt[256] = {
 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 8, 0,
 };
 
-/* open end game database file if needed */
+/* open and memory-map an end game database file; the mapping is */
+/* stored first and the handle last, with release semantics, so */
+/* that a thread which sees the handle also sees the mapping */
+/* in: ep = ptr to endfile info structure, not opened before */
+/* returns: 0 is success     */
+/*          1 file not found */
+/*          2 incorrect size */
+/*          3 other          */
+static int map_endfile(endhf *ep)
+{
+    char dbpath[PATH_MAX];
+    u8   *fptr;
+
+#ifdef _WIN32
+    HANDLE hf, hmap;
+
+    if (locate_dbfile(enddb_dirs, ep->name, dbpath) == NULL) /* full path */
+    {
+        printf("open_endfile: %s not found\n", ep->name);
+        return 1;
+    }
+    hf = CreateFile(dbpath, GENERIC_READ, FILE_SHARE_READ, NULL,
+                    OPEN_EXISTING,
+                    FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS,
+                    NULL);
+    if (hf == INVALID_HANDLE_VALUE)
+    {
+        printf("open_endfile: %s can't open\n", ep->name);
+        store_release(&ep->hf, INVALID_HANDLE_VALUE);
+        return 1;
+    }
+    if (GetFileSize(hf, NULL) != ep->size)
+    {
+        printf("open_endfile: %s wrong size\n", ep->name);
+        CloseHandle(hf);
+        store_release(&ep->hf, INVALID_HANDLE_VALUE);
+        return 2;
+    }
+    hmap = CreateFileMapping(hf, NULL, PAGE_READONLY, 0, 0, ep->name);
+    if (hmap == NULL)
+    {
+        printf("open_endfile: %s CreateFileMapping failed\n", ep->name);
+        CloseHandle(hf);
+        store_release(&ep->hf, INVALID_HANDLE_VALUE);
+        return 3;
+    }
+    fptr = (u8 *) MapViewOfFile(hmap, FILE_MAP_READ, 0, 0, 0);
+    if (fptr == NULL)
+    {
+        printf("open_endfile: %s MapViewOfFile failed\n", ep->name);
+        CloseHandle(hmap);
+        CloseHandle(hf);
+        store_release(&ep->hf, INVALID_HANDLE_VALUE);
+        return 3;
+    }
+    ep->hmap = hmap;
+    ep->fptr = fptr;
+    store_release(&ep->hf, hf); /* publish */
+#else
+    struct stat statbuf;
+    int fd, ret;
+
+    if (locate_dbfile(enddb_dirs, ep->name, dbpath) == NULL) /* full path */
+    {
+        printf("open_endfile: %s not found\n", ep->name);
+        store_release(&ep->fd, -1);
+        return 1;
+    }
+    fd = open(dbpath, O_RDONLY, 0);
+    if (fd == -1)
+    {
+        printf("open_endfile: %s can't open\n", ep->name);
+        store_release(&ep->fd, -1);
+        return 1;
+    }
+    ret = fstat(fd, &statbuf);
+    if (ret != 0 || statbuf.st_size != ep->size)
+    {
+        close(fd);
+        store_release(&ep->fd, -1);
+        printf("open_endfile: %s wrong size\n", ep->name);
+        return 2;
+    }
+    fptr = (u8 *) mmap(NULL, ep->size, PROT_READ, MAP_SHARED, fd, 0);
+    if (fptr == MAP_FAILED)
+    {
+        printf("open_endfile: %s mmap failed\n", ep->name);
+        close(fd);
+        store_release(&ep->fd, -1);
+        return 3;
+    }
+    madvise(fptr, ep->size, MADV_RANDOM);
+    ep->fptr = fptr;
+    store_release(&ep->fd, fd); /* publish */
+#endif
+    return 0;
+}
+
+/* take the lock for opening files */
+__inline__
+static void lock_end(void)
+{
+    while (atomic_tas32(&end_lock))
+    {
+        ;                         /* spin, opening is fast */
+    }
+}
+
+/* release the lock for opening files */
+__inline__
+static void unlock_end(void)
+{
+    atomic_clear32(&end_lock);
+}
+
+/* open end game database file if needed; the search threads and */
+/* the preload thread open files one at a time, see preload_enddb */
 /* in: ep = ptr to endfile info structure */
 /* returns: 0 is success     */
 /*          1 file not found */
@@ -234,99 +354,52 @@ char end_amt[256] = {
 /*          3 other          */
 static int open_endfile(endhf *ep)
 {
-    char *dbpath;
+    int ret = 0;
 
 #ifdef _WIN32
-    if (ep->hf == INVALID_HANDLE_VALUE)     /* got error opening file before */
+    HANDLE hf;
+
+    hf = load_acquire(&ep->hf); /* pairs with publish */
+    if (hf == INVALID_HANDLE_VALUE)         /* got error opening file before */
     {
         return 3;
     }
-    if (ep->hf == NULL)                     /* file not opened before */
+    if (hf == NULL)                         /* file not opened before */
     {
-        dbpath = locate_dbfile(enddb_dirs, ep->name); /* get the full path */
-        if (dbpath == NULL)
-        {
-            printf("open_endfile: %s not found\n", ep->name);
-            return 1;
-        }
-        ep->hf = CreateFile(dbpath, GENERIC_READ, FILE_SHARE_READ, NULL,
-                        OPEN_EXISTING,
-                        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS,
-                        NULL);
-        if (ep->hf == INVALID_HANDLE_VALUE)
-        {
-            printf("open_endfile: %s can't open\n", ep->name);
-            return 1;
-        }
-        if (GetFileSize(ep->hf, NULL) != ep->size)
-        {
-            printf("open_endfile: %s wrong size\n", ep->name);
-            CloseHandle(ep->hf);
-            ep->hf = INVALID_HANDLE_VALUE;
-            return 2;
-        }
-        ep->hmap = CreateFileMapping(ep->hf, NULL, PAGE_READONLY, 0, 0, ep->name);
-        if (ep->hmap == NULL)
+        lock_end();
+        if (ep->hf == NULL)
         {
-            printf("open_endfile: %s CreateFileMapping failed\n", ep->name);
-            CloseHandle(ep->hf);
-            ep->hf = INVALID_HANDLE_VALUE;
-            return 3;
+            ret = map_endfile(ep);
         }
-        ep->fptr = (u8 *) MapViewOfFile(ep->hmap, FILE_MAP_READ, 0, 0, 0);
-        if (ep->fptr == NULL)
+        else if (ep->hf == INVALID_HANDLE_VALUE)
         {
-            printf("open_endfile: %s MapViewOfFile failed\n", ep->name);
-            CloseHandle(ep->hmap);
-            ep->hmap = NULL;
-            CloseHandle(ep->hf);
-            ep->hf = INVALID_HANDLE_VALUE;
-            return 3;
+            ret = 3;
         }
+        unlock_end();
     }
 #else
-    struct stat statbuf;
-    int ret;
+    int fd;
 
-    if (ep->fd == -1)             /* got error opening file before */
+    fd = load_acquire(&ep->fd); /* pairs with publish */
+    if (fd == -1)                 /* got error opening file before */
     {
         return 3;
     }
-    if (ep->fd == 0)              /* file not opened before */
+    if (fd == 0)                  /* file not opened before */
     {
-        dbpath = locate_dbfile(enddb_dirs, ep->name); /* get the full path */
-        if (dbpath == NULL)
-        {
-            printf("open_endfile: %s not found\n", ep->name);
-            ep->fd = -1;
-            return 1;
-        }
-        ep->fd = open(dbpath, O_RDONLY, 0);
-        if (ep->fd == -1)
+        lock_end();
+        if (ep->fd == 0)
         {
-            printf("open_endfile: %s can't open\n", ep->name);
-            return 1;
+            ret = map_endfile(ep);
         }
-        ret = fstat(ep->fd, &statbuf);
-        if (ret != 0 || statbuf.st_size != ep->size)
+        else if (ep->fd == -1)
         {
-            close(ep->fd);
-            ep->fd = -1;
-            printf("open_endfile: %s wrong size\n", ep->name);
-            return 2;
+            ret = 3;
         }
-        ep->fptr = (u8 *) mmap(NULL, ep->size, PROT_READ, MAP_SHARED, ep->fd, 0);
-        if (ep->fptr == MAP_FAILED)
-        {
-            printf("open_endfile: %s mmap failed\n", ep->name);
-            close(ep->fd);
-            ep->fd = -1;
-            return 3;
-        }
-        madvise(ep->fptr, ep->size, MADV_RANDOM);
+        unlock_end();
     }
 #endif
-    return 0;
+    return ret;
 }
 
 /* prepare for database indexing */
@@ -335,6 +408,7 @@ static int open_endfile(endhf *ep)
 /*      epp = pptr to db info struct   */
 /* returns: TRUE if successful,        */
 /*          or FALSE if error/notfound */
+HOTPATH
 static bool prep_db(bitboard *bb, u64 bitlist[], endhf **epp)
 {
     u64 pcbits, pos, white, black, kings;
@@ -418,6 +492,7 @@ static bool prep_db(bitboard *bb, u64 bitlist[], endhf **epp)
 /* ply = ply level */
 /* out: valp = ptr to result value for side to move */
 /* returns: TRUE if value found */
+HOTPATH
 bool endgame_dtw(bitboard *bb, int ply, s32 *valp)
 {
     endhf *ep;
@@ -454,7 +529,7 @@ bool endgame_dtw(bitboard *bb, int ply, s32 *valp)
             end_acc[0]++;
             return FALSE;
         }
-        c = ep->fptr[ipos];
+        c = (ep->flat != NULL) ? ep->flat[ipos] : ep->fptr[ipos];
         break;
 
     case 4:
@@ -486,6 +561,11 @@ bool endgame_dtw(bitboard *bb, int ply, s32 *valp)
                 ipos = 50*ipos + __builtin_ctzll(pos);
             }
         }
+        if (ep->flat != NULL)
+        {
+            c = ep->flat[ipos];     /* decompressed: a single load */
+            break;
+        }
         li = ipos/256;
         ofs = (int) (ipos%256);
         idx = 0;
@@ -583,85 +663,38 @@ static u32 index_singletype(int sq, u64 pcbits)
     return result;
 }
 
-/* find value of current board in win-draw-loss databases */
-/* for 5 and 6 pieces, non-capture positions only */
-/* bb -> current board */
-/* out: valp = ptr to result value for side to move */
-/* returns: TRUE if value found */
-bool endgame_wdl(bitboard *bb, s32 *valp)
-{
-    endhf *ep;
-    int   i;
-    u32   ipos, p1, p2, p3;
-    u8    cval, *blkptr, *pb, *pz;
-    u64   bitlist[4];
-    u64   mwbits, kwbits, mbbits, kbbits;
-    u64   pcbits, pos;
-
-    static u32 pow3[] = { 1, 3, 9, 27, 81 };
+/* base-3 digits of the wdl database codes, 5 positions per code */
+static const u32 pow3[] = { 1, 3, 9, 27, 81 };
 
-    if (enddb_dirs[0] == '\0')
-    {
-        return FALSE;                   /* no endgame databases supplied */
-    }
-    if (!prep_db(bb, bitlist, &ep) || ep->fptr == NULL)
-    {
-        return FALSE;                   /* specific egdb file not found/error */
-    }
+/* the digits of each code as 2-bit values, the first position lowest; */
+/* all byte values, as the 255 code may repeat any of them */
+static u16 wdl_digits[256];
 
-    mbbits = bitlist[MB];
+/* nr. of positions that a wdl code stands for, */
+/* or 0 if a repeat count byte follows */
+static u8 wdl_npos[256];
 
-    pcbits = bitlist[MB] & ~ROW1;
-    mwbits = bitlist[MW];
-    i = popcount(pcbits);
-    while (pcbits != 0)                 /* remove white man index holes */
-    {
-        pos = pcbits & -pcbits;
-        pcbits -= pos;
-        mwbits += (mwbits & (pos - 1));
-    }
-    mwbits >>= 5 + i;
+/* nr. of bytes of a wdl code, including count and value bytes */
+static u8 wdl_size[256];
 
-    pcbits = bitlist[MB] | bitlist[MW];
-    kbbits = bitlist[KB];
-    i = popcount(pcbits);
-    while (pcbits != 0)                 /* remove black king index holes */
-    {
-        pos = pcbits & -pcbits;
-        pcbits -= pos;
-        kbbits += (kbbits & (pos - 1));
-    }
-    kbbits >>= i;
+/* the 5 values that a wdl code repeats, as a non-repeat code */
+static u8 wdl_rval[256];
 
-    pcbits = bitlist[MB] | bitlist[MW] | bitlist[KB];
-    kwbits = bitlist[KW];
-    i = popcount(pcbits);
-    while (pcbits != 0)                 /* remove white king index holes */
-    {
-        pos = pcbits & -pcbits;
-        pcbits -= pos;
-        kwbits += (kwbits & (pos - 1));
-    }
-    kwbits >>= i;
+bool end_refdecode = FALSE;     /* use wdl_decode_ref, for verification */
 
-    p3 = combi_array[50 - popcount(mbbits) - popcount(mwbits) -
-                     popcount(kbbits)][popcount(kwbits)];
-    p2 = p3*combi_array[50 - popcount(mbbits) - popcount(mwbits)]
-                       [popcount(kbbits)];
-    p1 = p2*combi_array[45][popcount(mwbits)];
-    ipos = index_singletype(45, mbbits)*p1
-         + index_singletype(45, mwbits)*p2
-         + index_singletype(50 - popcount(mbbits) - popcount(mwbits),
-                            kbbits)*p3
-         + index_singletype(50 - popcount(mbbits) - popcount(mwbits) -
-                            popcount(kbbits), kwbits);
+/* locate the compressed data of a block in a win-draw-loss database */
+/* ep -> db file info */
+/* blk = block number */
+/* returns: ptr to the first code of the block, or NULL if out of bounds */
+__inline__
+static u8 *wdl_block(endhf *ep, u32 blk)
+{
+    u8    *blkptr, *pb;
 
-    blkptr = ep->fptr + ep->idx*(ipos/1024);
-    pz = ep->fptr + ep->size;           /* end of file marker */
-    if (blkptr > pz - ep->idx)
+    blkptr = ep->fptr + ep->idx*blk;
+    if (blkptr > ep->fptr + ep->size - ep->idx)
     {
-        end_acc[0]++;
-        return FALSE;
+        return NULL;
     }
     pb = ep->fptr + *blkptr++;          /* find start of segment */
     pb += *blkptr++*256;                /* note: is little-endian */
@@ -670,12 +703,30 @@ bool endgame_wdl(bitboard *bb, s32 *valp)
     {
         pb += *blkptr*16777216;         /* for 4-byte index */
     }
-    i = (int) (ipos%1024);
+    return pb;
+}
+
+/* look up a position in a win-draw-loss database, the plain way: */
+/* by decoding its block code by code from the start up to the position */
+/* ep -> db file info */
+/* ipos = index of the position */
+/* returns: 0 = win, 1 = draw, 2 = loss, or -1 if error */
+static int wdl_decode_ref(endhf *ep, u32 ipos)
+{
+    int   i;
+    u8    cval, *pb, *pz;
+
+    pb = wdl_block(ep, ipos/WDLBLOCK);
+    if (pb == NULL)
+    {
+        return -1;
+    }
+    pz = ep->fptr + ep->size;           /* end of file marker */
+    i = (int) (ipos%WDLBLOCK);
     do {
         if (pb >= pz)                   /* bounds check */
         {
-            end_acc[0]++;
-            return FALSE;
+            return -1;
         }
         cval = *pb++;
         if (cval <= 242)                /* non-repeat code */
@@ -688,8 +739,7 @@ bool endgame_wdl(bitboard *bb, s32 *valp)
             {
                 if (pb >= pz)
                 {
-                    end_acc[0]++;
-                    return FALSE;
+                    return -1;
                 }
                 i -= *pb++*5;           /* next byte has repeat count */
             }
@@ -705,8 +755,7 @@ bool endgame_wdl(bitboard *bb, s32 *valp)
             {
                 if (pb >= pz)
                 {
-                    end_acc[0]++;
-                    return FALSE;
+                    return -1;
                 }
                 i -= *pb++*5;           /* next byte has repeat count */
             }
@@ -722,8 +771,7 @@ bool endgame_wdl(bitboard *bb, s32 *valp)
             {
                 if (pb >= pz)
                 {
-                    end_acc[0]++;
-                    return FALSE;
+                    return -1;
                 }
                 i -= *pb++*5;           /* next byte has repeat count */
             }
@@ -737,134 +785,496 @@ bool endgame_wdl(bitboard *bb, s32 *valp)
         {
             if (pb >= pz - 1)
             {
-                end_acc[0]++;
-                return FALSE;
+                return -1;
             }
             i -= *pb++*5;               /* next byte has repeat count */
             cval = *pb++;               /* next byte has repeated value */
         }
     } while (i >= 0);
-    cval = (cval/pow3[4 + (i + 1)%5])%3;
-    if (cval == 1)                      /* draw */
+    return (cval/pow3[4 + (i + 1)%5])%3;
+}
+
+/* look up a position in a win-draw-loss database, by decoding */
+/* its block from the start up to the position; the nr. of positions */
+/* and the length of each code come from tables, so that the only */
+/* branch of a step is the one that finds the code of the position */
+/* ep -> db file info */
+/* ipos = index of the position */
+/* returns: 0 = win, 1 = draw, 2 = loss, or -1 if error */
+HOTPATH
+static int wdl_decode(endhf *ep, u32 ipos)
+{
+    u32   i, n;
+    u8    cval, *pb, *pz;
+
+    pb = wdl_block(ep, ipos/WDLBLOCK);
+    if (pb == NULL)
     {
-        *valp = ep->matofs;             /* add small material offset */
+        return -1;
     }
-    else                                /* win or loss */
+    pz = ep->fptr + ep->size;           /* end of file marker */
+    i = ipos%WDLBLOCK;                  /* positions before the target */
+    while (pb < pz - 2)                 /* a code and 2 more bytes fit */
     {
-        *valp = INFIN - (MAXEXACT + MAX5PLY)/2;
-        if (ep->pccount == 6)           /* value depends on total */
-        {                               /* number of pieces       */
-            *valp = INFIN - (MAX5PLY + MAXPLY)/2;
-        }
-        if (cval == 2)
-        {
-            *valp = -*valp;             /* loss */
-        }
-        /* adjust for material and positional differences, */
-        /* encouraging promotions and conversions */
-        *valp += 10*popcount(bitlist[KW]) - 10*popcount(bitlist[KB]);
-        pcbits = bitlist[MW];
-        while (pcbits != 0)
-        {
-            pos = pcbits & -pcbits;
-            pcbits -= pos;
-            *valp += (49 - __builtin_ctzll(pos))/5;
-        }
-        pcbits = bitlist[MB];
-        while (pcbits != 0)
+        cval = *pb;
+        n = wdl_npos[cval];
+        n = (n != 0) ? n : pb[1]*5;     /* or next byte has repeat count */
+        if (i < n)
         {
-            pos = pcbits & -pcbits;
-            pcbits -= pos;
-            *valp -= __builtin_ctzll(pos)/5;
+            /* 255: next byte has repeated value */
+            cval = (cval == 255) ? pb[2] : wdl_rval[cval];
+            return (wdl_digits[cval] >> 2*(i%5)) & 3;
         }
+        i -= n;
+        pb += wdl_size[cval];
     }
-    end_acc[ep->pccount]++;
-    return TRUE;
+    return wdl_decode_ref(ep, ipos);    /* near the end of the file */
 }
 
-/* find endgame value of current board */
-/* bb -> current board */
-/* ply = ply level */
-/* out: valp = ptr to result value for side to move */
-/* returns: TRUE if value found */
-bool endgame_value(bitboard *bb, int ply, s32 *valp)
+/* add the values of some positions to a cached block, which is */
+/* filled up to a value shift within the byte of the next position */
+/* val -> the values of the block */
+/* vp -> index of the byte of the next position */
+/* accp -> bits of that byte not yet stored */
+/* shp -> value shift within that byte */
+/* bits = 2-bit values to add, the first position lowest */
+/* m = nr. of positions, 1..5 */
+__inline__
+static void wdl_store(u8 *val, u32 *vp, u32 *accp, u32 *shp, u32 bits, u32 m)
 {
-    movelist list;
-    int  pcnt, m;
-    s32  best, score;
-
-    /* check DTW endgame database */
-    pcnt = popcount(bb->white | bb->black);
-    if (pcnt <= DTWENDPC && endgame_dtw(bb, ply, valp))
+    *accp |= (bits & ((1U << 2*m) - 1)) << *shp;
+    *shp += 2*m;
+    while (*shp >= 8)
     {
-        return TRUE;
+        val[(*vp)++] |= (u8) *accp;
+        *accp >>= 8;
+        *shp -= 8;
     }
+}
 
-    /* generate all moves */
-    gen_moves(bb, &list, NULL, TRUE);
-    if (list.count == 0)
-    {
-        /* side to move can't move */
-        *valp = -INFIN + ply;
-        return TRUE;
-    }
+/* decode more of a cached block, until it covers a position; */
+/* the codes are those of wdl_decode */
+/* ep -> db file info */
+/* sp -> the cache set */
+/* w = the way of the block in the set */
+/* val -> the values of the block */
+/* pos = position within the block */
+/* returns: TRUE if the position is decoded, FALSE if error */
+HOTPATH
+static bool wdl_extend(endhf *ep, wdlset *sp, int w, u8 *val, u32 pos)
+{
+    u32   n, m, reps, v, q, acc, sh;
+    u8    cval, *pb, *pz;
+    bool  ok = TRUE;
 
-    /* check WDL endgame database */
-    if (pcnt > DTWENDPC && pcnt <= MAXENDPC)
+    pb = ep->fptr + sp->ofs[w];
+    pz = ep->fptr + ep->size;           /* end of file marker */
+    n = sp->count[w];
+    q = n/4;
+    acc = 0;
+    sh = 2*(n & 3);
+    while (n <= pos)
     {
-        if (list.npcapt == 0) /* non-capture position */
+        if (pb >= pz)                   /* bounds check */
         {
-            if (endgame_wdl(bb, valp))
-            {
-                return TRUE;
-            }
+            ok = FALSE;
+            break;
+        }
+        cval = *pb;
+        if (cval <= 242)                /* non-repeat code */
+        {
+            reps = 1;
+            pb++;
         }
-        else /* play out the captures until quiescence reached */
+        else if (cval <= 254)           /* repeat code for win/draw/loss */
         {
-            best = -INFIN;
-            for (m = 0; m < list.count; m++)
+            if ((cval - 243)%4 == 3)
             {
-                if (!endgame_value(&list.move[m], ply + 1, &score))/* recurse */
-                {
-                    return FALSE;
-                }
-                score = -score; /* convert for other side to move */
-                if (score > best)
+                if (pb >= pz - 1)
                 {
-                    best = score;
+                    ok = FALSE;
+                    break;
                 }
+                reps = pb[1];           /* next byte has repeat count */
+                pb += 2;
             }
-            *valp = best;
-            return TRUE;
+            else
+            {
+                reps = (cval - 243)%4 + 2;  /* repeat count 2,3,4 */
+                pb++;
+            }
+            cval = 121*((cval - 243)/4);    /* 00000, 11111 or 22222 */
+        }
+        else                            /* 255 = repeat code for other */
+        {
+            if (pb >= pz - 2)
+            {
+                ok = FALSE;
+                break;
+            }
+            reps = pb[1];               /* next byte has repeat count */
+            cval = pb[2];               /* next byte has repeated value */
+            pb += 3;
+        }
+
+        m = min(reps*5, WDLBLOCK - n);
+        n += m;
+        if (cval == 0 || cval == 121 || cval == 242)
+        {
+            /* a single value: fill whole bytes where possible */
+            v = (cval/121)*0x55;
+            while (sh != 0 && m > 0)
+            {
+                wdl_store(val, &q, &acc, &sh, v, 1);
+                m--;
+            }
+            if (m >= 4)
+            {
+                memset(&val[q], v, m/4);
+                q += m/4;
+                m &= 3;
+            }
+            if (m > 0)
+            {
+                wdl_store(val, &q, &acc, &sh, v, m);
+            }
+        }
+        else
+        {
+            /* codes start at a multiple of 5 positions */
+            for (; m > 5; m -= 5)
+            {
+                wdl_store(val, &q, &acc, &sh, wdl_digits[cval], 5);
+            }
+            wdl_store(val, &q, &acc, &sh, wdl_digits[cval], m);
         }
     }
-    return FALSE;
+    if (sh != 0)
+    {
+        val[q] |= (u8) acc;
+    }
+    sp->count[w] = (u16) n;
+    sp->ofs[w] = (u32) (pb - ep->fptr);
+    return ok;
 }
 
-/* check presence & correct contents of end game files */
-/* (takes a long time) */
-void check_enddb(void)
+/* look up a position in a win-draw-loss database, through the block */
+/* cache of this thread; a block is decoded incrementally, only as far */
+/* as the positions probed in it, so a miss costs no more than */
+/* wdl_decode, and replaces the least recently used block of its set */
+/* ep -> db file info */
+/* ipos = index of the position */
+/* returns: 0 = win, 1 = draw, 2 = loss, or -1 if error */
+HOTPATH
+static int wdl_cached(endhf *ep, u32 ipos)
 {
-    endhf *ep;
-    u16 crc, x;
-    int i, n, ret, total, correct;
+    wdlcache *cp = end_cache;
+    wdlset *sp;
+    u32   tag, pos, h;
+    int   w, i;
+    u8    *pb, *val;
 
-    total = correct = 0;
-    for (i = 0; i < elements(end_ref); i++)
+    tag = ((u32) (ep - end_set + 1) << WDLBLKBITS) + ipos/WDLBLOCK;
+    pos = ipos%WDLBLOCK;
+    h = tag*0x9e3779b9U;
+    sp = &cp->set[((u64) (h ^ (h >> 15))*cp->sets) >> 32];
+    for (w = 0; w < WDLWAYS; w++)
     {
-        ep = end_ref[i];
-        if (ep != NULL)
+        if (sp->tag[w] == tag)
         {
-            total++;
-            ret = open_endfile(ep);
-            if (ret == 0)
-            {
-                if (ep->fptr == NULL)
-                {
-                    printf("check_enddb: %s not mmap'ed\n", ep->name);
-                    continue; /* with next file */
-                }
-                /* file integrity check using CRC16 algorithm, variant: */
+            break; /* out of for loop */
+        }
+    }
+
+    if (w < WDLWAYS)
+    {
+        end_blk[0]++;
+        for (i = 0; sp->lru[i] != w; i++)
+        {
+            ;
+        }
+    }
+    else
+    {
+        end_blk[1]++;
+        pb = wdl_block(ep, ipos/WDLBLOCK);
+        if (pb == NULL)
+        {
+            return -1;
+        }
+        i = WDLWAYS - 1;
+        w = sp->lru[i];                 /* evict the least recently used */
+        sp->tag[w] = tag;
+        sp->ofs[w] = (u32) (pb - ep->fptr);
+        sp->count[w] = 0;
+        memset(cp->val[(sp - cp->set)*WDLWAYS + w], 0, WDLBLOCK/4);
+    }
+    for (; i > 0; i--)                  /* make it the most recently used */
+    {
+        sp->lru[i] = sp->lru[i - 1];
+    }
+    sp->lru[0] = (u8) w;
+
+    val = cp->val[(sp - cp->set)*WDLWAYS + w];
+    if (pos >= sp->count[w] && !wdl_extend(ep, sp, w, val, pos))
+    {
+        sp->tag[w] = 0;                 /* don't keep a broken block */
+        return -1;
+    }
+    return (val[pos/4] >> 2*(pos & 3)) & 3;
+}
+
+/* find value of current board in win-draw-loss databases */
+/* for 5 and 6 pieces, non-capture positions only */
+/* bb -> current board */
+/* out: valp = ptr to result value for side to move */
+/* returns: TRUE if value found */
+HOTPATH
+bool endgame_wdl(bitboard *bb, s32 *valp)
+{
+    endhf *ep;
+    int   i;
+    u32   ipos, p1, p2, p3;
+    u64   bitlist[4];
+    u64   mwbits, kwbits, mbbits, kbbits;
+    u64   pcbits, pos;
+
+    if (enddb_dirs[0] == '\0')
+    {
+        return FALSE;                   /* no endgame databases supplied */
+    }
+    if (!prep_db(bb, bitlist, &ep) || ep->fptr == NULL)
+    {
+        return FALSE;                   /* specific egdb file not found/error */
+    }
+
+    end_probes[ep - end_set]++;
+    mbbits = bitlist[MB];
+
+    pcbits = bitlist[MB] & ~ROW1;
+    mwbits = bitlist[MW];
+    i = popcount(pcbits);
+    while (pcbits != 0)                 /* remove white man index holes */
+    {
+        pos = pcbits & -pcbits;
+        pcbits -= pos;
+        mwbits += (mwbits & (pos - 1));
+    }
+    mwbits >>= 5 + i;
+
+    pcbits = bitlist[MB] | bitlist[MW];
+    kbbits = bitlist[KB];
+    i = popcount(pcbits);
+    while (pcbits != 0)                 /* remove black king index holes */
+    {
+        pos = pcbits & -pcbits;
+        pcbits -= pos;
+        kbbits += (kbbits & (pos - 1));
+    }
+    kbbits >>= i;
+
+    pcbits = bitlist[MB] | bitlist[MW] | bitlist[KB];
+    kwbits = bitlist[KW];
+    i = popcount(pcbits);
+    while (pcbits != 0)                 /* remove white king index holes */
+    {
+        pos = pcbits & -pcbits;
+        pcbits -= pos;
+        kwbits += (kwbits & (pos - 1));
+    }
+    kwbits >>= i;
+
+    p3 = combi_array[50 - popcount(mbbits) - popcount(mwbits) -
+                     popcount(kbbits)][popcount(kwbits)];
+    p2 = p3*combi_array[50 - popcount(mbbits) - popcount(mwbits)]
+                       [popcount(kbbits)];
+    p1 = p2*combi_array[45][popcount(mwbits)];
+    ipos = index_singletype(45, mbbits)*p1
+         + index_singletype(45, mwbits)*p2
+         + index_singletype(50 - popcount(mbbits) - popcount(mwbits),
+                            kbbits)*p3
+         + index_singletype(50 - popcount(mbbits) - popcount(mwbits) -
+                            popcount(kbbits), kwbits);
+
+    if (ep->bits != NULL && ipos < ep->npos)
+    {
+        i = (ep->bits[ipos/4] >> 2*(ipos & 3)) & 3;
+    }
+    else if (end_cache != NULL)
+    {
+        i = wdl_cached(ep, ipos);
+    }
+    else if (end_refdecode)
+    {
+        i = wdl_decode_ref(ep, ipos);
+    }
+    else
+    {
+        i = wdl_decode(ep, ipos);
+    }
+    if (i < 0)
+    {
+        end_acc[0]++;                   /* bounds check failure */
+        return FALSE;
+    }
+    if (i == 1)                         /* draw */
+    {
+        *valp = ep->matofs;             /* add small material offset */
+    }
+    else                                /* win or loss */
+    {
+        *valp = INFIN - (MAXEXACT + MAX5PLY)/2;
+        if (ep->pccount == 6)           /* value depends on total */
+        {                               /* number of pieces       */
+            *valp = INFIN - (MAX5PLY + MAXPLY)/2;
+        }
+        if (i == 2)
+        {
+            *valp = -*valp;             /* loss */
+        }
+        /* adjust for material and positional differences, */
+        /* encouraging promotions and conversions */
+        *valp += 10*popcount(bitlist[KW]) - 10*popcount(bitlist[KB]);
+        pcbits = bitlist[MW];
+        while (pcbits != 0)
+        {
+            pos = pcbits & -pcbits;
+            pcbits -= pos;
+            *valp += (49 - __builtin_ctzll(pos))/5;
+        }
+        pcbits = bitlist[MB];
+        while (pcbits != 0)
+        {
+            pos = pcbits & -pcbits;
+            pcbits -= pos;
+            *valp -= __builtin_ctzll(pos)/5;
+        }
+    }
+    end_acc[ep->pccount]++;
+    return TRUE;
+}
+
+/* find endgame value of current board */
+/* bb -> current board */
+/* ply = ply level */
+/* out: valp = ptr to result value for side to move */
+/* returns: TRUE if value found */
+bool endgame_value(bitboard *bb, int ply, s32 *valp)
+{
+    cmovelist list;
+    bitboard child;
+    int  pcnt, m;
+    s32  best, score;
+
+    /* check DTW endgame database */
+    pcnt = popcount(bb->white | bb->black);
+    if (pcnt <= DTWENDPC && endgame_dtw(bb, ply, valp))
+    {
+        return TRUE;
+    }
+
+    /* a non-capture position needs no move list */
+    if (!has_capt(bb))
+    {
+        if (count_noncapt(bb) == 0)
+        {
+            /* side to move can't move */
+            *valp = -INFIN + ply;
+            return TRUE;
+        }
+
+        /* check WDL endgame database */
+        return pcnt > DTWENDPC && pcnt <= MAXENDPC && endgame_wdl(bb, valp);
+    }
+
+    if (pcnt > DTWENDPC && pcnt <= MAXENDPC)
+    {
+        /* play out the captures until quiescence reached */
+        gen_cmoves(bb, &list, FALSE);
+        best = -INFIN;
+        for (m = 0; m < list.count; m++)
+        {
+            make_move(bb, &list.move[m], &child);
+            if (!endgame_value(&child, ply + 1, &score)) /* recurse */
+            {
+                return FALSE;
+            }
+            score = -score; /* convert for other side to move */
+            if (score > best)
+            {
+                best = score;
+            }
+        }
+        *valp = best;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/* initialize a wdl block cache, see wdl_cached */
+/* out: cp -> the cache */
+/* kib = memory budget in KiB, 0 for no cache */
+/* returns: TRUE if successful */
+bool init_wdlcache(wdlcache *cp, u32 kib)
+{
+    u64 size;
+    u32 i, w;
+
+    memset(cp, 0, sizeof *cp);
+    if (kib == 0)
+    {
+        return TRUE;
+    }
+    /* the sets, followed by the values of their blocks */
+    size = sizeof(wdlset) + WDLWAYS*WDLBLOCK/4;
+    cp->sets = max(1, (u32) (kib*1024ULL/size));
+    size *= cp->sets;
+#ifdef _WIN32
+    cp->set = _aligned_malloc(size, 64);
+    if (cp->set == NULL)
+#else
+    if (posix_memalign((void **)&cp->set, 64, size) != 0)
+#endif
+    {
+        memset(cp, 0, sizeof *cp);
+        return FALSE;
+    }
+    cp->val = (void *) (cp->set + cp->sets);
+    memset(cp->set, 0, cp->sets*sizeof(wdlset)); /* all tags unused */
+    for (i = 0; i < cp->sets; i++)
+    {
+        for (w = 0; w < WDLWAYS; w++)
+        {
+            cp->set[i].lru[w] = (u8) w;
+        }
+    }
+    return TRUE;
+}
+
+/* check presence & correct contents of end game files */
+/* (takes a long time) */
+void check_enddb(void)
+{
+    endhf *ep;
+    u16 crc, x;
+    int i, n, ret, total, correct;
+
+    total = correct = 0;
+    for (i = 0; i < elements(end_ref); i++)
+    {
+        ep = end_ref[i];
+        if (ep != NULL)
+        {
+            total++;
+            ret = open_endfile(ep);
+            if (ret == 0)
+            {
+                if (ep->fptr == NULL)
+                {
+                    printf("check_enddb: %s not mmap'ed\n", ep->name);
+                    continue; /* with next file */
+                }
+                /* file integrity check using CRC16 algorithm, variant: */
                 /* width=16 poly=0x1021 init=0xffff refin=false refout=false */
                 /* xorout=0x0000 check=0x29b1 name="CRC-16/CCITT-FALSE" */
                 crc = 0xffff;
@@ -898,6 +1308,17 @@ void init_enddb(char *dirs)
     int mw, kw, mb, kb;
     int present[MAXENDPC + 1];
     int total[MAXENDPC + 1];
+    char path[PATH_MAX];
+
+    combi_array[0][0] = 1;        /* set up combination lookup table */
+    for (i = 1; i <= 50; i++)
+    {
+        combi_array[i][0] = 1;
+        for (j = 1; j < 8; j++)
+        {
+            combi_array[i][j] = combi_array[i - 1][j - 1] + combi_array[i - 1][j];
+        }
+    }
 
     strncpy(enddb_dirs, dirs, sizeof enddb_dirs - 1);
     memset(present, 0, sizeof present);
@@ -931,9 +1352,16 @@ void init_enddb(char *dirs)
             j++;
         }
         ep->matofs = mw + 2*kw - mb - 2*kb;
+        if (ep->pccount > DTWENDPC)
+        {
+            /* the range of the index computed by endgame_wdl */
+            ep->npos = combi_array[45][mb]*combi_array[45][mw]*
+                       combi_array[50 - mb - mw][kb]*
+                       combi_array[50 - mb - mw - kb][kw];
+        }
         end_ref[EF*EF*EF*mw + EF*EF*kw + EF*mb + kb] = ep;
         total[ep->pccount]++;
-        if (locate_dbfile(enddb_dirs, ep->name) != NULL)
+        if (locate_dbfile(enddb_dirs, ep->name, path) != NULL)
         {
             present[ep->pccount]++;
         }
@@ -951,13 +1379,364 @@ void init_enddb(char *dirs)
         }
     }
 
-    combi_array[0][0] = 1;        /* set up combination lookup table */
-    for (i = 1; i <= 50; i++)
+    for (i = 0; i < 256; i++)     /* set up wdl code tables */
     {
-        combi_array[i][0] = 1;
-        for (j = 1; j < 8; j++)
+        wdl_digits[i] = 0;
+        for (j = 0; j < 5; j++)
         {
-            combi_array[i][j] = combi_array[i - 1][j - 1] + combi_array[i - 1][j];
+            wdl_digits[i] |= ((i/pow3[j])%3) << 2*j;
+        }
+        if (i <= 242)             /* non-repeat code */
+        {
+            wdl_npos[i] = 5;
+            wdl_size[i] = 1;
+            wdl_rval[i] = i;
+        }
+        else if (i <= 254)        /* repeat code for win/draw/loss */
+        {
+            wdl_npos[i] = ((i - 243)%4 == 3) ? 0 : ((i - 243)%4 + 2)*5;
+            wdl_size[i] = ((i - 243)%4 == 3) ? 2 : 1;
+            wdl_rval[i] = 121*((i - 243)/4);
+        }
+        else                      /* repeat code for other */
+        {
+            wdl_npos[i] = 0;
+            wdl_size[i] = 3;
+            wdl_rval[i] = 0;
+        }
+    }
+}
+
+/* decompress all blocks of a 4-piece dtw database, */
+/* with the same codes as endgame_dtw */
+/* ep -> db file info */
+/* out: flat -> the value of each index */
+/* returns: TRUE if successful */
+static bool unpack_dtw4(endhf *ep, u8 *flat)
+{
+    u8    c, *pb, *pz;
+    u32   li, idx, n, amt;
+
+    pz = ep->fptr + ep->size;   /* end of file marker */
+    for (li = 0; li*256 < DTW4POS; li++)
+    {
+        idx = 0;
+        if (li > 0)
+        {
+            pb = &end_ref[0]->fptr[ep->idx*73242 + li*3 - 3];
+            if (pb > end_ref[0]->fptr + end_ref[0]->size - 3)
+            {
+                return FALSE;
+            }
+            idx  = *pb++;           /* get 3-byte index, is little-endian */
+            idx += *pb++*256;
+            idx += *pb*65536;
+        }
+        pb = &ep->fptr[idx];        /* starting point for decompression */
+        for (n = li*256; n < min(li*256 + 256, DTW4POS); n += amt)
+        {
+            if (pb >= pz)
+            {
+                return FALSE;
+            }
+            c = *pb++;
+            if (c >= 255)           /* repeat code */
+            {
+                if (pb >= pz - 1)
+                {
+                    return FALSE;
+                }
+                amt = *pb++ + 1;
+                c = end_val[*pb++];
+            }
+            else if (c == 191)      /* draw repeat code */
+            {
+                if (pb >= pz)
+                {
+                    return FALSE;
+                }
+                amt = *pb++ + 1;
+                c = 100;
+            }
+            else
+            {
+                amt = end_amt[c];
+                c = end_val[c];
+            }
+            memset(&flat[n], c, min(amt, min(li*256 + 256, DTW4POS) - n));
+        }
+    }
+    return TRUE;
+}
+
+/* load the 2 to 4 piece dtw databases into memory, decompressed to */
+/* one byte per index, so that endgame_dtw needs a single load; */
+/* files that are missing or fail stay on disk, as before */
+/* returns: nr. of bytes used */
+u64 unpack_enddb(void)
+{
+    endhf *ep;
+    int i, n = 0;
+    u64 total = 0;
+    u32 size, tick;
+    char path[PATH_MAX];
+
+    tick = get_tick();
+    for (i = 0; i < elements(end_set); i++)
+    {
+        ep = &end_set[i];
+        if (ep->pccount > DTWENDPC || ep->flat != NULL ||
+            (ep->pccount == DTWENDPC && ep->idx < 0) ||  /* end4.idx */
+            locate_dbfile(enddb_dirs, ep->name, path) == NULL ||
+            open_endfile(ep) != 0)
+        {
+            continue;
+        }
+        if (ep->pccount == DTWENDPC && open_endfile(end_ref[0]) != 0)
+        {
+            break; /* out of for loop, no 4-pc index file */
+        }
+        size = (ep->pccount == DTWENDPC) ? DTW4POS : (u32) ep->size;
+        ep->flat = malloc(size);
+        if (ep->flat == NULL)
+        {
+            printf("unpack_enddb: %s out of memory\n", ep->name);
+            break; /* out of for loop */
+        }
+        if (ep->pccount < DTWENDPC)
+        {
+            memcpy(ep->flat, ep->fptr, size);
+        }
+        else if (!unpack_dtw4(ep, ep->flat))
+        {
+            printf("unpack_enddb: %s decompression failed\n", ep->name);
+            free(ep->flat);
+            ep->flat = NULL;
+            continue;
+        }
+        total += size;
+        n++;
+    }
+    printf("unpacked %d dtw db files, %" PRIu64 "MiB, %u ms\n",
+           n, total >> 20, get_tick() - tick);
+    return total;
+}
+
+/* size of the bitbase of a wdl database, in whole blocks */
+/* ep -> db file info */
+/* returns: nr. of bytes */
+__inline__
+static u64 bits_size(endhf *ep)
+{
+    return ((u64) ep->npos + WDLBLOCK - 1)/WDLBLOCK*(WDLBLOCK/4);
+}
+
+/* decode all blocks of a wdl database into a bitbase */
+/* ep -> db file info */
+/* out: bits -> the 2-bit values, zeroed */
+/* returns: TRUE if successful */
+static bool build_wdlbits(endhf *ep, u8 *bits)
+{
+    wdlset set;                 /* decoding state, as in the block cache */
+    u32   blk;
+    u8    *pb;
+
+    for (blk = 0; (u64) blk*WDLBLOCK < ep->npos; blk++)
+    {
+        pb = wdl_block(ep, blk);
+        if (pb == NULL)
+        {
+            return FALSE;
+        }
+        set.ofs[0] = (u32) (pb - ep->fptr);
+        set.count[0] = 0;
+        if (!wdl_extend(ep, &set, 0, &bits[blk*(WDLBLOCK/4)],
+                        min(ep->npos - blk*WDLBLOCK, WDLBLOCK) - 1))
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/* keep the wdl databases that were probed most decompressed in */
+/* memory, as bitbases of 2 bits per position, within a memory */
+/* budget; the others are probed in their files, as before; */
+/* the counts are this thread's end_probes, to which the search adds */
+/* those of its helper threads after each search; they are halved */
+/* afterwards, so that recent games weigh most; */
+/* only call this when no search is running */
+/* budget = nr. of bytes, 0 to free all bitbases */
+/* returns: nr. of bytes used */
+u64 select_wdlbits(u64 budget)
+{
+    endhf *ep, *best;
+    bool  chosen[ENDFILES];
+    int   i, n = 0;
+    u64   used = 0;
+    u32   tick;
+
+    tick = get_tick();
+    memset(chosen, 0, sizeof chosen);
+    while (TRUE)                /* most probed first, as long as they fit */
+    {
+        best = NULL;
+        for (i = 0; i < ENDFILES; i++)
+        {
+            ep = &end_set[i];
+            if (ep->pccount > DTWENDPC && !chosen[i] &&
+                end_probes[i] != 0 && used + bits_size(ep) <= budget &&
+                (best == NULL || end_probes[i] > end_probes[best - end_set]) &&
+                open_endfile(ep) == 0 && ep->fptr != NULL) /* was opened */
+            {
+                best = ep;
+            }
+        }
+        if (best == NULL)
+        {
+            break; /* out of while loop */
+        }
+        chosen[best - end_set] = TRUE;
+        used += bits_size(best);
+    }
+
+    for (i = 0; i < ENDFILES; i++)  /* free the others first */
+    {
+        ep = &end_set[i];
+        if (!chosen[i] && ep->bits != NULL)
+        {
+            free(ep->bits);
+            ep->bits = NULL;
+        }
+    }
+    for (i = 0; i < ENDFILES; i++)
+    {
+        ep = &end_set[i];
+        end_probes[i] /= 2;
+        if (!chosen[i])
+        {
+            continue;
+        }
+        n++;
+        if (ep->bits != NULL)
+        {
+            continue;           /* kept from the previous selection */
         }
+        ep->bits = calloc(bits_size(ep), 1);
+        if (ep->bits == NULL || !build_wdlbits(ep, ep->bits))
+        {
+            printf("select_wdlbits: %s %s\n", ep->name,
+                   (ep->bits == NULL) ? "out of memory" : "decoding failed");
+            free(ep->bits);
+            ep->bits = NULL;
+            used -= bits_size(ep);
+            n--;
+            continue;
+        }
+        printf("wdl bitbase %s %" PRIu64 "KiB\n",
+               ep->name, bits_size(ep) >> 10);
+    }
+    printf("wdl bitbases: %d classes, %" PRIu64 "MiB, %u ms\n",
+           n, used >> 20, get_tick() - tick);
+    return used;
+}
+
+/* preload thread: open all db files that are present, read them into */
+/* memory, and lock those of the selected piece counts; progress goes */
+/* to the log, the search threads can use the files in the meantime */
+/* arg -> piece count flags, TRUE to lock */
+/* returns: NULL */
+static void *preload_thread(void *arg)
+{
+    bool  *lockpc = (bool *) arg;
+    bool  found[ENDFILES];
+    endhf *ep;
+    int   i, n = 0, nfail = 0, pct = 0;
+    u64   total = 0, done = 0, locked = 0;
+    off_t ofs;
+    u32   tick;
+    char  path[PATH_MAX];
+
+    tick = get_tick();
+    for (i = 0; i < ENDFILES; i++)
+    {
+        found[i] = (locate_dbfile(enddb_dirs, end_set[i].name, path) != NULL);
+        total += (found[i]) ? end_set[i].size : 0;
     }
+
+    for (i = 0; i < ENDFILES; i++)
+    {
+        ep = &end_set[i];
+        if (!found[i] || open_endfile(ep) != 0 || ep->fptr == NULL)
+        {
+            continue;
+        }
+#ifndef _WIN32
+        madvise(ep->fptr, ep->size, MADV_WILLNEED); /* start reading ahead */
+#endif
+        for (ofs = 0; ofs < ep->size; ofs += 4096)
+        {
+            (void) ((volatile u8 *) ep->fptr)[ofs]; /* wait for every page */
+        }
+        if (lockpc[ep->pccount])
+        {
+#ifdef _WIN32
+            nfail++;                    /* not supported */
+#else
+            if (mlock(ep->fptr, ep->size) == 0)
+            {
+                locked += ep->size;
+            }
+            else
+            {
+                nfail++;
+            }
+#endif
+        }
+        n++;
+        done += ep->size;
+        if (done*10/total > (u64) pct/10)
+        {
+            pct = (int) (done*10/total)*10;
+            printf("egdb preload %d%% (%" PRIu64 "MiB of %" PRIu64 "MiB)\n",
+                   pct, done >> 20, total >> 20);
+            fflush(stdout);
+        }
+    }
+    printf("egdb preload done: %d files, %" PRIu64 "MiB, %" PRIu64
+           "MiB locked, %u ms\n", n, done >> 20, locked >> 20,
+           get_tick() - tick);
+    if (nfail != 0)
+    {
+        printf("egdb preload: %d files could not be locked, "
+               "see ulimit -l\n", nfail);
+    }
+    fflush(stdout);
+    return NULL;
+}
+
+/* start reading the db files into memory in the background, so that */
+/* the first probes in a game don't wait for the disk */
+/* lockpcs -> piece counts, e.g. "56", whose files are locked in memory */
+/*            (on linux, within the memlock limit), or "" for none */
+/* returns: TRUE if the preload thread started */
+bool preload_enddb(char *lockpcs)
+{
+    static bool lockpc[MAXENDPC + 1];
+    thrd  handle;
+    int   i;
+
+    for (i = 0; lockpcs[i] != '\0'; i++)
+    {
+        if (lockpcs[i] >= '2' && lockpcs[i] <= '0' + MAXENDPC)
+        {
+            lockpc[lockpcs[i] - '0'] = TRUE;
+        }
+    }
+    if (!start_thread(&handle, preload_thread, lockpc))
+    {
+        return FALSE;
+    }
+    detach_thread(handle);      /* it finishes on its own, never joined */
+    return TRUE;
 }
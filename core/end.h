@@ -19,8 +19,10 @@
 
 #define DTWENDPC 4 /* max. piece count in exact dtw databases */
 #define MAXENDPC 6 /* max. piece count in wdl databases */
+#define DTW4POS 6250000 /* nr. of indices of a 4-piece dtw database, 50^4 */
 
 #define EF 6                     /* endgame ref. table dimension per piece */
+#define ENDFILES 156             /* nr. of endgame database files */
 
 typedef struct {                 /* end game info file structure */
     off_t size;
@@ -30,18 +32,52 @@ typedef struct {                 /* end game info file structure */
     char  name[14];
     int   matofs;
 #ifdef _WIN32
-    HANDLE hf;
+    volatile HANDLE hf;          /* published last, see map_endfile */
     HANDLE hmap;
 #else
-    int   fd;
+    volatile int fd;             /* published last, see map_endfile */
 #endif
     u8    *fptr;
+    u8    *flat;                 /* dtw values in memory, see unpack_enddb */
+    u32   npos;                  /* nr. of positions of a wdl database */
+    u8    *bits;                 /* wdl values in memory, see select_wdlbits */
 } endhf;
 
-extern u64 end_acc[7];         /* access counts per piececount, and errors */
+/* the wdl databases are compressed in blocks of 1024 positions; */
+/* decoded blocks are kept in a per-thread cache, see wdl_cached */
+#define WDLBLOCK 1024
+#define WDLBLKBITS 22            /* block number bits of a cache tag */
+
+/* a wdl cache set fills one cache line and holds the tags of 4 */
+/* decoded blocks, with the ways in least recently used order */
+#define WDLWAYS 4
+
+typedef struct {
+    u32   tag[WDLWAYS];          /* db file nr. + 1 and block nr., 0 = unused */
+    u32   ofs[WDLWAYS];          /* file offset where decoding continues */
+    u16   count[WDLWAYS];        /* nr. of positions decoded so far */
+    u8    lru[WDLWAYS];          /* the ways, most recently used first */
+    u8    unused[20];
+} wdlset;
+
+typedef struct {                 /* cache of decoded wdl blocks */
+    u32   sets;                  /* nr. of sets, 0 = no cache */
+    wdlset *set;                 /* the sets */
+    u8    (*val)[WDLBLOCK/4];    /* 2-bit values, 0=win 1=draw 2=loss, */
+} wdlcache;                      /* WDLWAYS blocks per set */
+
+extern THREADLOCAL u64 end_acc[7];         /* access counts per piececount, and errors */
+extern THREADLOCAL u64 end_blk[2];         /* wdl block cache hits and misses */
+extern THREADLOCAL wdlcache *end_cache;    /* wdl block cache of this thread, or NULL */
+extern THREADLOCAL u64 end_probes[ENDFILES]; /* wdl probes per db file */
+extern bool end_refdecode;                 /* use the plain wdl decoder */
 
 extern bool endgame_dtw(bitboard *bb, int ply, s32 *valp);
 extern bool endgame_wdl(bitboard *bb, s32 *valp);
 extern bool endgame_value(bitboard *bb, int ply, s32 *valp);
+extern bool init_wdlcache(wdlcache *cp, u32 kib);
 extern void check_enddb(void);
 extern void init_enddb(char *dirs);
+extern u64 unpack_enddb(void);
+extern u64 select_wdlbits(u64 budget);
+extern bool preload_enddb(char *lockpcs);
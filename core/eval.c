@@ -62,7 +62,7 @@ featentry feat[] = {    /* the features and weights per game phase */
 s32 king_val[PHASES] = /* a king is valued at VAL_MAN plus: */
 { 4*VAL_MAN/3, 7*VAL_MAN/3, 7*VAL_MAN/3, 7*VAL_MAN/3 };
 
-u64 eval_count;                /* nr. of board evaluations */
+THREADLOCAL u64 eval_count;    /* nr. of board evaluations */
 
 /* get the game phase */
 /* pcnt = piece count */
@@ -85,6 +85,7 @@ int game_phase(int pcnt)
 /* bb -> current board */
 /* returns: evaluation score for side to move */
 /* please excuse the mixing of bools and ints */
+HOTPATH
 s32 eval_board(bitboard *bb)
 {
     u64 wm, bm, wk, bk;
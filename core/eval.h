@@ -19,7 +19,7 @@
 
 #define VAL_MAN 10000000
 
-extern u64 eval_count;      /* nr. of board evaluations */
+extern THREADLOCAL u64 eval_count;      /* nr. of board evaluations */
 
 extern int game_phase(int pcnt);
 extern s32 eval_board(bitboard *bb);
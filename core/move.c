@@ -39,21 +39,70 @@
 #define RAYMASK_SE ((1ULL <<  6) | (1ULL << 12) | (1ULL << 18) | (1ULL << 24) \
                   | (1ULL << 30) | (1ULL << 36) | (1ULL << 42))
 
+#if defined(__GNUC__) && defined(__x86_64__)
+/* BMI2 path of the king move counting and capture tests, */
+/* selected at runtime by init_movegen */
+#define HAVE_BMI2
+#include <immintrin.h>
+#define TARGET_BMI2 __attribute__((target("bmi2,popcnt")))
+#endif
+
+#ifdef HAVE_BMI2
+/* king attack tables for the BMI2 path: per direction and origin, */
+/* the squares along the ray up to and including the first occupied */
+/* one, indexed by the PEXT of the occupied squares on the ray; the */
+/* occupancy of the last square on the ray doesn't change the set, */
+/* so it is left out of the mask (halves the tables) */
+typedef struct {
+    u64 mask;           /* relevant ray squares */
+    u64 *att;           /* attack sets of the ray */
+} kingray;
+static u64 kingatt[3072];           /* attack sets of all rays (3068 used) */
+static kingray kingrays[4][64];     /* per direction and origin */
+static bool use_bmi2 = FALSE;       /* whether the BMI2 path is selected */
+
+/* king directions, in the order nw, ne, sw, se; shift as in addlist_noncapt */
+static const int kingshift[4] = { 6, 5, -5, -6 };
+#endif
+
+/* per side pieces and promotion row; with side a compile-time */
+/* constant these reduce to a plain field access or a constant */
+#define OWNBITS(bb, side) (((side) == W) ? (bb)->white : (bb)->black)
+#define OPPBITS(bb, side) (((side) == W) ? (bb)->black : (bb)->white)
+#define PROMROW(side)     (((side) == W) ? ROW1 : ROW10)
+
+/* set of captures of 4 or more pieces, to find duplicates: */
+/* open addressing with linear probing, entries are move index + 1, */
+/* 0 = empty slot; 256 slots keep the load factor below 1/2 */
+#define DUPSETSIZE 256
+
+/* state of the move generator while constructing a move list */
+typedef struct {
+    cmovelist *list;    /* the compact move list being constructed */
+    lnentry *lnptr;     /* ptr to long notation array, or NULL */
+    u64 frombit;        /* starting position of captor */
+    u64 empty;          /* empty positions, including frombit */
+    u64 oppbits;        /* opponents at start of capture */
+    u64 promrow;        /* promotion row of the side to move */
+    int piece;          /* type of captor, MW/KW/MB/KB */
+    u64 tp[32];         /* turning points of capture */
+    u8 dupset[DUPSETSIZE]; /* captures in the list, if npcapt >= 4 */
+} genstate;
+
 /* statistics */
-u64 moves_gencalls;     /* nr. of move generator calls made */
-u64 moves_generated;    /* nr. of moves generated */
+THREADLOCAL u64 moves_gencalls;     /* nr. of move generator calls made */
+THREADLOCAL u64 moves_generated;    /* nr. of moves generated */
 
-/* add the capture move to the movelist */
-/* listptr -> move list structure being constructed */
+/* add the capture move to the compact move list */
+/* gs -> move generator state */
 /* pcbit = final bit position of capturing piece */
 /* captbits = positions of captured pieces */
-/* type = capturing piece type, M or K */
-__inline__
-static void addlist_capt(movelist *listptr, u64 pcbit, u64 captbits, int type)
+HOTPATH
+static void addlist_capt(genstate *gs, u64 pcbit, u64 captbits)
 {
-    bitboard *mvptr;
-    bitboard *bb;
-    int i, npcapt;
+    cmovelist *listptr = gs->list;
+    cmove *mvptr;
+    int i, npcapt, from, to, slot;
 
     npcapt = popcount(captbits); /* number of pieces captured */
 
@@ -68,441 +117,429 @@ static void addlist_capt(movelist *listptr, u64 pcbit, u64 captbits, int type)
     {
         listptr->count = 0;
         listptr->npcapt = npcapt;
-    }
-
-    bb = listptr->bb; /* the parent bitboard */
-
-    mvptr = &listptr->move[listptr->count];
-
-    /* construct the move's resulting bitboard */
-    if (bb->side == W)
-    {
-        mvptr->side = B;
-        mvptr->white = bb->white - listptr->frombit + pcbit;
-        mvptr->black = bb->black - captbits;
-        if (type == M)
+        if (npcapt >= 4)
         {
-            /* remove any captured kings and do promotion */
-            mvptr->kings = (bb->kings & ~captbits) | (pcbit & ROW1);
+            memset(gs->dupset, 0, sizeof(gs->dupset));
         }
     }
-    else
-    {
-        mvptr->side = W;
-        mvptr->white = bb->white - captbits;
-        mvptr->black = bb->black - listptr->frombit + pcbit;
-        if (type == M)
-        {
-            /* remove any captured kings and do promotion */
-            mvptr->kings = (bb->kings & ~captbits) | (pcbit & ROW10);
-        }
-    }
-    if (type == K)
-    {
-        /* remove any captured kings and update moving king */
-        mvptr->kings = (bb->kings & ~captbits) - listptr->frombit + pcbit;
-    }
+
+    from = __builtin_ctzll(gs->frombit);
+    to = __builtin_ctzll(pcbit);
 
     if (npcapt >= 4)
     {
-        /* check for duplicate (only the order of captures is different) */
-        for (i = 0; i < listptr->count; i++)
+        /* check for duplicate (only the order of captures is different); */
+        /* from, to and the captured pieces determine the resulting board */
+        slot = (int) (((captbits ^ ((u64) from << 56) ^ ((u64) to << 48))
+                       * 0x9e3779b97f4a7c15ULL) >> 56);
+        while ((i = gs->dupset[slot]) != 0)
         {
-            if (listptr->move[i].white == mvptr->white &&
-                listptr->move[i].black == mvptr->black)
+            if (listptr->move[i - 1].capt == captbits &&
+                listptr->move[i - 1].from == from &&
+                listptr->move[i - 1].to == to)
             {
                 return;
             }
+            slot = (slot + 1) & (DUPSETSIZE - 1);
         }
+        gs->dupset[slot] = (u8) (listptr->count + 1);
     }
 
-    /* link to parent board */
-    mvptr->parent = bb;
-
+    mvptr = &listptr->move[listptr->count];
+    mvptr->capt = captbits;
+    mvptr->from = (u8) from;
+    mvptr->to = (u8) to;
+    mvptr->piece = (u8) gs->piece;
+    /* a man that ends its capture on the promotion row promotes */
+    mvptr->newpiece = (u8) (gs->piece | ((pcbit & gs->promrow) != 0));
     /* draw info: capture = non-zero, also for print_move when from=to */
-    mvptr->moveinfo = conv_to_square(pcbit);
+    mvptr->moveinfo = (u8) conv_to_square(pcbit);
 
     /* provide long notation if requested */
-    if (listptr->lnptr != NULL)
+    if (gs->lnptr != NULL)
     {
         /* construct long notation from saved turning points */
-        listptr->lnptr[listptr->count].square[0] = 
-            conv_to_square(listptr->frombit);
+        gs->lnptr[listptr->count].square[0] = conv_to_square(gs->frombit);
         for (i = 1; i <= npcapt; i++)
         {
-            listptr->lnptr[listptr->count].square[i] = 
-                conv_to_square(listptr->tp[i]);
+            gs->lnptr[listptr->count].square[i] = conv_to_square(gs->tp[i]);
         }
-        listptr->lnptr[listptr->count].square[i] = 0; /* terminator */
+        gs->lnptr[listptr->count].square[i] = 0; /* terminator */
     }
     listptr->count++;
 }
 
 /* recursive part of man capture move generation */
-/* listptr -> move list structure being constructed */
+/* gs -> move generator state */
 /* pcbit = current bit position of capturing man */
 /* captbits = positions of pieces captured so far */
-static void mancapt_part(movelist *listptr, u64 pcbit, u64 captbits)
+HOTPATH
+static void mancapt_part(genstate *gs, u64 pcbit, u64 captbits)
 {
     u64 oppbits;
 
     /* get opponent pieces that are left on the board */
-    oppbits = listptr->oppbits - captbits;
+    oppbits = gs->oppbits - captbits;
 
     /* save turning point */
-    listptr->tp[popcount(captbits)] = pcbit;
+    gs->tp[popcount(captbits)] = pcbit;
 
     /* adjacent opponent piece followed by an empty square in nw direction? */
-    if (((pcbit >> 12) & (oppbits >> 6) & listptr->empty) != 0)
+    if (((pcbit >> 12) & (oppbits >> 6) & gs->empty) != 0)
     {
-        mancapt_part(listptr, pcbit >> 12, captbits | (pcbit >> 6));
+        mancapt_part(gs, pcbit >> 12, captbits | (pcbit >> 6));
     }
 
     /* adjacent opponent piece followed by an empty square in ne direction? */
-    if (((pcbit >> 10) & (oppbits >> 5) & listptr->empty) != 0)
+    if (((pcbit >> 10) & (oppbits >> 5) & gs->empty) != 0)
     {
-        mancapt_part(listptr, pcbit >> 10, captbits | (pcbit >> 5));
+        mancapt_part(gs, pcbit >> 10, captbits | (pcbit >> 5));
     }
 
     /* adjacent opponent piece followed by an empty square in sw direction? */
-    if (((pcbit << 10) & (oppbits << 5) & listptr->empty) != 0)
+    if (((pcbit << 10) & (oppbits << 5) & gs->empty) != 0)
     {
-        mancapt_part(listptr, pcbit << 10, captbits | (pcbit << 5));
+        mancapt_part(gs, pcbit << 10, captbits | (pcbit << 5));
     }
 
     /* adjacent opponent piece followed by an empty square in se direction? */
-    if (((pcbit << 12) & (oppbits << 6) & listptr->empty) != 0)
+    if (((pcbit << 12) & (oppbits << 6) & gs->empty) != 0)
     {
-        mancapt_part(listptr, pcbit << 12, captbits | (pcbit << 6));
+        mancapt_part(gs, pcbit << 12, captbits | (pcbit << 6));
     }
 
     /* store the capture move sequence (if no longer sequence found) */
-    addlist_capt(listptr, pcbit, captbits, M);
+    addlist_capt(gs, pcbit, captbits);
 }
 
 /* recursive parts of king capture move generation */
-/* listptr -> move list structure being constructed */
+/* gs -> move generator state */
 /* pcbit = current bit position of capturing king */
 /* captbits = positions of pieces captured so far */
 
 /* forward declarations to make compiler happy */
-static void kingcapt_ne(movelist *listptr, u64 pcbit, u64 captbits);
-static void kingcapt_sw(movelist *listptr, u64 pcbit, u64 captbits);
-static void kingcapt_se(movelist *listptr, u64 pcbit, u64 captbits);
+HOTPATH
+static void kingcapt_ne(genstate *gs, u64 pcbit, u64 captbits);
+HOTPATH
+static void kingcapt_sw(genstate *gs, u64 pcbit, u64 captbits);
+HOTPATH
+static void kingcapt_se(genstate *gs, u64 pcbit, u64 captbits);
 
 /* direction is northwest (-6) */
-static void kingcapt_nw(movelist *listptr, u64 pcbit, u64 captbits)
+HOTPATH
+static void kingcapt_nw(genstate *gs, u64 pcbit, u64 captbits)
 {
     u64 oppbits, ray, nearest;
     u64 origpcbit = pcbit;
 
     /* get opponent pieces that are left on the board */
-    oppbits = listptr->oppbits - captbits;
+    oppbits = gs->oppbits - captbits;
 
     /* repeat for every trailing empty square */
     do {
         /* save turning point */
-        listptr->tp[popcount(captbits)] = pcbit;
+        gs->tp[popcount(captbits)] = pcbit;
 
         /* find non-empty squares in sideways direction (ne) */
-        ray = (RAYMASK_NE >> __builtin_clzll(pcbit)) & ~listptr->empty;
+        ray = (RAYMASK_NE >> __builtin_clzll(pcbit)) & ~gs->empty;
         /* get MS1B */
         nearest = 1ULL << (63 ^ __builtin_clzll(ray | 1ULL));
         /* is it an opponent piece followed by an empty square? */
-        if ((nearest & oppbits & (listptr->empty << 5)) != 0)
+        if ((nearest & oppbits & (gs->empty << 5)) != 0)
         {
-            kingcapt_ne(listptr, nearest >> 5, captbits | nearest);
+            kingcapt_ne(gs, nearest >> 5, captbits | nearest);
         }
 
         /* find non-empty squares in sideways direction (sw) */
-        ray = (RAYMASK_SW * pcbit) & ~listptr->empty;
+        ray = (RAYMASK_SW * pcbit) & ~gs->empty;
         /* get LS1B */
         nearest = ray & -ray;
         /* is it an opponent piece followed by an empty square? */
-        if ((nearest & oppbits & (listptr->empty >> 5)) != 0)
+        if ((nearest & oppbits & (gs->empty >> 5)) != 0)
         {
-            kingcapt_sw(listptr, nearest << 5, captbits | nearest);
+            kingcapt_sw(gs, nearest << 5, captbits | nearest);
         }
 
         /* store the capture move sequence (if no longer sequence found) */
-        addlist_capt(listptr, pcbit, captbits, K);
+        addlist_capt(gs, pcbit, captbits);
         pcbit >>= 6;
-    } while ((pcbit & listptr->empty) != 0);
+    } while ((pcbit & gs->empty) != 0);
 
     /* found non-empty square, see if we can capture again in same direction */
-    if ((pcbit & oppbits & (listptr->empty << 6)) != 0)
+    if ((pcbit & oppbits & (gs->empty << 6)) != 0)
     {
         /* save turning point */
-        listptr->tp[popcount(captbits)] = origpcbit;
+        gs->tp[popcount(captbits)] = origpcbit;
 
-        kingcapt_nw(listptr, pcbit >> 6, captbits | pcbit);
+        kingcapt_nw(gs, pcbit >> 6, captbits | pcbit);
     }
 }
 
 /* direction is northeast (-5) */
-static void kingcapt_ne(movelist *listptr, u64 pcbit, u64 captbits)
+HOTPATH
+static void kingcapt_ne(genstate *gs, u64 pcbit, u64 captbits)
 {
     u64 oppbits, ray, nearest;
     u64 origpcbit = pcbit;
 
     /* get opponent pieces that are left on the board */
-    oppbits = listptr->oppbits - captbits;
+    oppbits = gs->oppbits - captbits;
 
     /* repeat for every trailing empty square */
     do {
         /* save turning point */
-        listptr->tp[popcount(captbits)] = pcbit;
+        gs->tp[popcount(captbits)] = pcbit;
 
         /* find non-empty squares in sideways direction (nw) */
-        ray = (RAYMASK_NW >> __builtin_clzll(pcbit)) & ~listptr->empty;
+        ray = (RAYMASK_NW >> __builtin_clzll(pcbit)) & ~gs->empty;
         /* get MS1B */
         nearest = 1ULL << (63 ^ __builtin_clzll(ray | 1ULL));
         /* is it an opponent piece followed by an empty square? */
-        if ((nearest & oppbits & (listptr->empty << 6)) != 0)
+        if ((nearest & oppbits & (gs->empty << 6)) != 0)
         {
-            kingcapt_nw(listptr, nearest >> 6, captbits | nearest);
+            kingcapt_nw(gs, nearest >> 6, captbits | nearest);
         }
 
         /* find non-empty squares in sideways direction (se) */
-        ray = (RAYMASK_SE * pcbit) & ~listptr->empty;
+        ray = (RAYMASK_SE * pcbit) & ~gs->empty;
         /* get LS1B */
         nearest = ray & -ray;
         /* is it an opponent piece followed by an empty square? */
-        if ((nearest & oppbits & (listptr->empty >> 6)) != 0)
+        if ((nearest & oppbits & (gs->empty >> 6)) != 0)
         {
-            kingcapt_se(listptr, nearest << 6, captbits | nearest);
+            kingcapt_se(gs, nearest << 6, captbits | nearest);
         }
 
         /* store the capture move sequence (if no longer sequence found) */
-        addlist_capt(listptr, pcbit, captbits, K);
+        addlist_capt(gs, pcbit, captbits);
         pcbit >>= 5;
-    } while ((pcbit & listptr->empty) != 0);
+    } while ((pcbit & gs->empty) != 0);
 
     /* found non-empty square, see if we can capture again in same direction */
-    if ((pcbit & oppbits & (listptr->empty << 5)) != 0)
+    if ((pcbit & oppbits & (gs->empty << 5)) != 0)
     {
         /* save turning point */
-        listptr->tp[popcount(captbits)] = origpcbit;
+        gs->tp[popcount(captbits)] = origpcbit;
 
-        kingcapt_ne(listptr, pcbit >> 5, captbits | pcbit);
+        kingcapt_ne(gs, pcbit >> 5, captbits | pcbit);
     }
 }
 
 /* direction is southwest (+5) */
-static void kingcapt_sw(movelist *listptr, u64 pcbit, u64 captbits)
+HOTPATH
+static void kingcapt_sw(genstate *gs, u64 pcbit, u64 captbits)
 {
     u64 oppbits, ray, nearest;
     u64 origpcbit = pcbit;
 
     /* get opponent pieces that are left on the board */
-    oppbits = listptr->oppbits - captbits;
+    oppbits = gs->oppbits - captbits;
 
     /* repeat for every trailing empty square */
     do {
         /* save turning point */
-        listptr->tp[popcount(captbits)] = pcbit;
+        gs->tp[popcount(captbits)] = pcbit;
 
         /* find non-empty squares in sideways direction (nw) */
-        ray = (RAYMASK_NW >> __builtin_clzll(pcbit)) & ~listptr->empty;
+        ray = (RAYMASK_NW >> __builtin_clzll(pcbit)) & ~gs->empty;
         /* get MS1B */
         nearest = 1ULL << (63 ^ __builtin_clzll(ray | 1ULL));
         /* is it an opponent piece followed by an empty square? */
-        if ((nearest & oppbits & (listptr->empty << 6)) != 0)
+        if ((nearest & oppbits & (gs->empty << 6)) != 0)
         {
-            kingcapt_nw(listptr, nearest >> 6, captbits | nearest);
+            kingcapt_nw(gs, nearest >> 6, captbits | nearest);
         }
 
         /* find non-empty squares in sideways direction (se) */
-        ray = (RAYMASK_SE * pcbit) & ~listptr->empty;
+        ray = (RAYMASK_SE * pcbit) & ~gs->empty;
         /* get LS1B */
         nearest = ray & -ray;
         /* is it an opponent piece followed by an empty square? */
-        if ((nearest & oppbits & (listptr->empty >> 6)) != 0)
+        if ((nearest & oppbits & (gs->empty >> 6)) != 0)
         {
-            kingcapt_se(listptr, nearest << 6, captbits | nearest);
+            kingcapt_se(gs, nearest << 6, captbits | nearest);
         }
 
         /* store the capture move sequence (if no longer sequence found) */
-        addlist_capt(listptr, pcbit, captbits, K);
+        addlist_capt(gs, pcbit, captbits);
         pcbit <<= 5;
-    } while ((pcbit & listptr->empty) != 0);
+    } while ((pcbit & gs->empty) != 0);
 
     /* found non-empty square, see if we can capture again in same direction */
-    if ((pcbit & oppbits & (listptr->empty >> 5)) != 0)
+    if ((pcbit & oppbits & (gs->empty >> 5)) != 0)
     {
         /* save turning point */
-        listptr->tp[popcount(captbits)] = origpcbit;
+        gs->tp[popcount(captbits)] = origpcbit;
 
-        kingcapt_sw(listptr, pcbit << 5, captbits | pcbit);
+        kingcapt_sw(gs, pcbit << 5, captbits | pcbit);
     }
 }
 
 /* direction is southeast (+6) */
-static void kingcapt_se(movelist *listptr, u64 pcbit, u64 captbits)
+HOTPATH
+static void kingcapt_se(genstate *gs, u64 pcbit, u64 captbits)
 {
     u64 oppbits, ray, nearest;
     u64 origpcbit = pcbit;
 
     /* get opponent pieces that are left on the board */
-    oppbits = listptr->oppbits - captbits;
+    oppbits = gs->oppbits - captbits;
 
     /* repeat for every trailing empty square */
     do {
         /* save turning point */
-        listptr->tp[popcount(captbits)] = pcbit;
+        gs->tp[popcount(captbits)] = pcbit;
 
         /* find non-empty squares in sideways direction (ne) */
-        ray = (RAYMASK_NE >> __builtin_clzll(pcbit)) & ~listptr->empty;
+        ray = (RAYMASK_NE >> __builtin_clzll(pcbit)) & ~gs->empty;
         /* get MS1B */
         nearest = 1ULL << (63 ^ __builtin_clzll(ray | 1ULL));
         /* is it an opponent piece followed by an empty square? */
-        if ((nearest & oppbits & (listptr->empty << 5)) != 0)
+        if ((nearest & oppbits & (gs->empty << 5)) != 0)
         {
-            kingcapt_ne(listptr, nearest >> 5, captbits | nearest);
+            kingcapt_ne(gs, nearest >> 5, captbits | nearest);
         }
 
         /* find non-empty squares in sideways direction (sw) */
-        ray = (RAYMASK_SW * pcbit) & ~listptr->empty;
+        ray = (RAYMASK_SW * pcbit) & ~gs->empty;
         /* get LS1B */
         nearest = ray & -ray;
         /* is it an opponent piece followed by an empty square? */
-        if ((nearest & oppbits & (listptr->empty >> 5)) != 0)
+        if ((nearest & oppbits & (gs->empty >> 5)) != 0)
         {
-            kingcapt_sw(listptr, nearest << 5, captbits | nearest);
+            kingcapt_sw(gs, nearest << 5, captbits | nearest);
         }
 
         /* store the capture move sequence (if no longer sequence found) */
-        addlist_capt(listptr, pcbit, captbits, K);
+        addlist_capt(gs, pcbit, captbits);
         pcbit <<= 6;
-    } while ((pcbit & listptr->empty) != 0);
+    } while ((pcbit & gs->empty) != 0);
 
     /* found non-empty square, see if we can capture again in same direction */
-    if ((pcbit & oppbits & (listptr->empty >> 6)) != 0)
+    if ((pcbit & oppbits & (gs->empty >> 6)) != 0)
     {
         /* save turning point */
-        listptr->tp[popcount(captbits)] = origpcbit;
+        gs->tp[popcount(captbits)] = origpcbit;
 
-        kingcapt_se(listptr, pcbit << 6, captbits | pcbit);
+        kingcapt_se(gs, pcbit << 6, captbits | pcbit);
     }
 }
 
 /* king capture move generation */
 /* for one king, looks in all 4 directions for a possible capture */
-/* listptr -> move list structure being constructed */
-static void kingcapt_main(movelist *listptr)
+/* gs -> move generator state */
+HOTPATH
+static void kingcapt_main(genstate *gs)
 {
     u64 ray, nearest, pcbit;
 
     /* starting position of capturing king */
-    pcbit = listptr->frombit;
+    pcbit = gs->frombit;
 
     /* find non-empty squares in nw direction */
-    ray = (RAYMASK_NW >> __builtin_clzll(pcbit)) & ~listptr->empty;
+    ray = (RAYMASK_NW >> __builtin_clzll(pcbit)) & ~gs->empty;
     /* get MS1B */
     nearest = 1ULL << (63 ^ __builtin_clzll(ray | 1ULL));
     /* is it an opponent piece followed by an empty square? */
-    if ((nearest & listptr->oppbits & (listptr->empty << 6)) != 0)
+    if ((nearest & gs->oppbits & (gs->empty << 6)) != 0)
     {
-        kingcapt_nw(listptr, nearest >> 6, nearest);
+        kingcapt_nw(gs, nearest >> 6, nearest);
     }
 
     /* find non-empty squares in ne direction */
-    ray = (RAYMASK_NE >> __builtin_clzll(pcbit)) & ~listptr->empty;
+    ray = (RAYMASK_NE >> __builtin_clzll(pcbit)) & ~gs->empty;
     /* get MS1B */
     nearest = 1ULL << (63 ^ __builtin_clzll(ray | 1ULL));
     /* is it an opponent piece followed by an empty square? */
-    if ((nearest & listptr->oppbits & (listptr->empty << 5)) != 0)
+    if ((nearest & gs->oppbits & (gs->empty << 5)) != 0)
     {
-        kingcapt_ne(listptr, nearest >> 5, nearest);
+        kingcapt_ne(gs, nearest >> 5, nearest);
     }
 
     /* find non-empty squares in sw direction */
-    ray = (RAYMASK_SW * pcbit) & ~listptr->empty;
+    ray = (RAYMASK_SW * pcbit) & ~gs->empty;
     /* get LS1B */
     nearest = ray & -ray;
     /* is it an opponent piece followed by an empty square? */
-    if ((nearest & listptr->oppbits & (listptr->empty >> 5)) != 0)
+    if ((nearest & gs->oppbits & (gs->empty >> 5)) != 0)
     {
-        kingcapt_sw(listptr, nearest << 5, nearest);
+        kingcapt_sw(gs, nearest << 5, nearest);
     }
 
     /* find non-empty squares in se direction */
-    ray = (RAYMASK_SE * pcbit) & ~listptr->empty;
+    ray = (RAYMASK_SE * pcbit) & ~gs->empty;
     /* get LS1B */
     nearest = ray & -ray;
     /* is it an opponent piece followed by an empty square? */
-    if ((nearest & listptr->oppbits & (listptr->empty >> 6)) != 0)
+    if ((nearest & gs->oppbits & (gs->empty >> 6)) != 0)
     {
-        kingcapt_se(listptr, nearest << 6, nearest);
+        kingcapt_se(gs, nearest << 6, nearest);
     }
 }
 
 /* generate the capture moves */
 /* bb -> current board */
-/* listptr -> move list structure being constructed */
-static void genmoves_capt(bitboard *bb, movelist *listptr)
+/* gs -> move generator state */
+/* side = side to move, W or B, a constant at each call site, so that */
+/* a version specialized per side is inlined there */
+FORCEINLINE
+static void genmoves_capt(bitboard *bb, genstate *gs, int side)
 {
     u64 empty, tobits, to, men, king, kings;
 
     empty = ALL50 - bb->white - bb->black;
 
-    if (bb->side == W)
-    {
-        listptr->oppbits = bb->black;
-        men = bb->white & ~bb->kings;
-        kings = bb->white & bb->kings;
-    }
-    else
-    {
-        listptr->oppbits = bb->white;
-        men = bb->black & ~bb->kings;
-        kings = bb->black & bb->kings;
-    }
+    gs->oppbits = OPPBITS(bb, side);
+    gs->promrow = PROMROW(side);
+    men = OWNBITS(bb, side) & ~bb->kings;
+    kings = OWNBITS(bb, side) & bb->kings;
+    gs->piece = 2*side + M; /* MW or MB */
 
     /* per direction, find in one fell swoop the set of men that */
     /* have an adjacent opponent piece followed by an empty square; */
     /* then for each man construct its capture move */
 
-    tobits = (men >> 12) & (listptr->oppbits >> 6) & empty; /* nw */
+    tobits = (men >> 12) & (gs->oppbits >> 6) & empty; /* nw */
     while (tobits != 0)
     {
         to = tobits & -tobits;
         tobits -= to;
-        listptr->frombit = (to << 12);
-        listptr->empty = empty | (to << 12);
-        mancapt_part(listptr, to, (to << 6));
+        gs->frombit = (to << 12);
+        gs->empty = empty | (to << 12);
+        mancapt_part(gs, to, (to << 6));
     }
 
-    tobits = (men >> 10) & (listptr->oppbits >> 5) & empty; /* ne */
+    tobits = (men >> 10) & (gs->oppbits >> 5) & empty; /* ne */
     while (tobits != 0)
     {
         to = tobits & -tobits;
         tobits -= to;
-        listptr->frombit = (to << 10);
-        listptr->empty = empty | (to << 10);
-        mancapt_part(listptr, to, (to << 5));
+        gs->frombit = (to << 10);
+        gs->empty = empty | (to << 10);
+        mancapt_part(gs, to, (to << 5));
     }
 
-    tobits = (men << 10) & (listptr->oppbits << 5) & empty; /* sw */
+    tobits = (men << 10) & (gs->oppbits << 5) & empty; /* sw */
     while (tobits != 0)
     {
         to = tobits & -tobits;
         tobits -= to;
-        listptr->frombit = (to >> 10);
-        listptr->empty = empty | (to >> 10);
-        mancapt_part(listptr, to, (to >> 5));
+        gs->frombit = (to >> 10);
+        gs->empty = empty | (to >> 10);
+        mancapt_part(gs, to, (to >> 5));
     }
 
-    tobits = (men << 12) & (listptr->oppbits << 6) & empty; /* se */
+    tobits = (men << 12) & (gs->oppbits << 6) & empty; /* se */
     while (tobits != 0)
     {
         to = tobits & -tobits;
         tobits -= to;
-        listptr->frombit = (to >> 12);
-        listptr->empty = empty | (to >> 12);
-        mancapt_part(listptr, to, (to >> 6));
+        gs->frombit = (to >> 12);
+        gs->empty = empty | (to >> 12);
+        mancapt_part(gs, to, (to >> 6));
     }
 
+    gs->piece++; /* KW or KB */
     while (kings != 0)
     {
         /* no fell swoop per direction for kings because of */
@@ -510,294 +547,625 @@ static void genmoves_capt(bitboard *bb, movelist *listptr)
         /* for all directions */
         king = kings & -kings;
         kings -= king;
-        listptr->frombit = king;
-        listptr->empty = empty | king;
-        kingcapt_main(listptr);
+        gs->frombit = king;
+        gs->empty = empty | king;
+        kingcapt_main(gs);
     }
 }
 
+/* add the non-capture moves in one direction to the compact move list */
+/* for kings, also the moves to the trailing empty squares are added */
+/* mvptr -> next free entry in the move list */
+/* tobits = destinations of the pieces with an adjacent empty square */
+/* shift = direction (bit position difference from destination to origin) */
+/* empty = empty positions */
+/* piece = type of the moving pieces, MW/KW/MB/KB */
+/* promrow = promotion row of the moving side */
+/* returns: ptr to next free entry in the move list */
+__inline__
+static cmove *addlist_noncapt(cmove *mvptr, u64 tobits, int shift, u64 empty,
+                              int piece, u64 promrow)
+{
+    u64 to;
+    int from;
+
+    while (tobits != 0)
+    {
+        to = tobits & -tobits;
+        tobits -= to;
+        from = __builtin_ctzll(to) + shift;
+        do
+        {
+            mvptr->capt = 0;
+            mvptr->from = (u8) from;
+            mvptr->to = (u8) __builtin_ctzll(to);
+            mvptr->piece = (u8) piece;
+            mvptr->newpiece = (u8) (piece | ((to & promrow) != 0));
+            /* draw info: man move = 1, king move = 0 */
+            mvptr->moveinfo = (u8) ((piece & K) == M);
+            mvptr++;
+            if ((piece & K) == M)
+            {
+                break;
+            }
+            /* more empty squares beyond? */
+            to = ((shift > 0) ? (to >> shift) : (to << -shift)) & empty;
+        } while (to != 0);
+    }
+    return mvptr;
+}
+
 /* generate the non-capture moves */
 /* bb -> current board */
-/* listptr -> move list structure being constructed */
-static void genmoves_noncapt(bitboard *bb, movelist *listptr)
+/* gs -> move generator state */
+/* side = side to move, W or B, a constant as for genmoves_capt */
+FORCEINLINE
+static void genmoves_noncapt(bitboard *bb, genstate *gs, int side)
 {
-    bitboard *mvptr;
-    u64 tobits, to, from, empty, men, kings;
-    int m;
+    cmove *mvptr;
+    u64 empty, men, kings;
+    int m, king;
 
-    mvptr = listptr->move;
+    mvptr = gs->list->move;
     empty = ALL50 - bb->white - bb->black;
+    men = OWNBITS(bb, side) & ~bb->kings;
+    kings = OWNBITS(bb, side) & bb->kings;
 
-    if (bb->side == W)
+    if (side == W)
     {
-        men = bb->white & ~bb->kings;
-
         /* for each 'north' direction, find the set of */
         /* white men that have an adjacent empty square */
+        mvptr = addlist_noncapt(mvptr, (men >> 6) & empty, 6, empty, MW, ROW1);
+        mvptr = addlist_noncapt(mvptr, (men >> 5) & empty, 5, empty, MW, ROW1);
+    }
+    else
+    {
+        /* for each 'south' direction, find the set of */
+        /* black men that have an adjacent empty square */
+        mvptr = addlist_noncapt(mvptr, (men << 5) & empty, -5, empty, MB, ROW10);
+        mvptr = addlist_noncapt(mvptr, (men << 6) & empty, -6, empty, MB, ROW10);
+    }
 
-        tobits = (men >> 6) & empty; /* nw */
-        while (tobits != 0)
+    if (kings != 0)
+    {
+        /* for each direction, find the set of kings */
+        /* that have an adjacent empty square */
+        king = 2*side + K; /* KW or KB */
+        mvptr = addlist_noncapt(mvptr, (kings >> 6) & empty, 6, empty, king, 0);
+        mvptr = addlist_noncapt(mvptr, (kings >> 5) & empty, 5, empty, king, 0);
+        mvptr = addlist_noncapt(mvptr, (kings << 5) & empty, -5, empty, king, 0);
+        mvptr = addlist_noncapt(mvptr, (kings << 6) & empty, -6, empty, king, 0);
+    }
+
+    /* update the count of moves found */
+    gs->list->count = (int) (mvptr - gs->list->move);
+
+    /* provide long notations if requested */
+    if (gs->lnptr != NULL)
+    {
+        for (m = 0; m < gs->list->count; m++)
         {
-            to = tobits & -tobits;
-            tobits -= to;
-            mvptr->white = bb->white - (to << 6) + to;
-            mvptr->black = bb->black;
-            mvptr->kings = bb->kings | (to & ROW1); /* promotion */
-            mvptr->side = B;
-            mvptr->moveinfo = 1; /* draw info: it's a man move */
-            mvptr->parent = bb;  /* link to parent board */
-            mvptr++;
+            gs->lnptr[m].square[0] = 
+                conv_to_square(1ULL << gs->list->move[m].from);
+            gs->lnptr[m].square[1] = 
+                conv_to_square(1ULL << gs->list->move[m].to);
+            gs->lnptr[m].square[2] = 0; /* terminator */
         }
+    }
+}
+
+/* construct the compact moves */
+/* bb -> current board */
+/* listptr -> compact move list structure to be constructed */
+/* lnptr -> long notation array to be constructed, or NULL */
+/* genall = if TRUE, generate all valid moves including non-captures */
+/*          if FALSE, generate captures only */
+HOTPATH
+static void gen_list(bitboard *bb, cmovelist *listptr, lnentry *lnptr,
+                     bool genall)
+{
+    genstate gs;
+
+    listptr->count = 0;
+    listptr->npcapt = 0;
+    gs.list = listptr;
+    gs.lnptr = lnptr;
 
-        tobits = (men >> 5) & empty; /* ne */
-        while (tobits != 0)
+    /* dispatch once to the versions specialized per side */
+    if (bb->side == W)
+    {
+        genmoves_capt(bb, &gs, W);
+        if (genall && listptr->count == 0)
         {
-            to = tobits & -tobits;
-            tobits -= to;
-            mvptr->white = bb->white - (to << 5) + to;
-            mvptr->black = bb->black;
-            mvptr->kings = bb->kings | (to & ROW1); /* promotion */
-            mvptr->side = B;
-            mvptr->moveinfo = 1; /* draw info: it's a man move */
-            mvptr->parent = bb;  /* link to parent board */
-            mvptr++;
+            genmoves_noncapt(bb, &gs, W);
         }
-
-        kings = bb->white & bb->kings;
-        if (kings != 0)
+    }
+    else
+    {
+        genmoves_capt(bb, &gs, B);
+        if (genall && listptr->count == 0)
         {
-            /* for each direction, find the set of white kings */
-            /* that have an adjacent empty square */
+            genmoves_noncapt(bb, &gs, B);
+        }
+    }
 
-            tobits = (kings >> 6) & empty; /* nw */
-            while (tobits != 0)
-            {
-                to = tobits & -tobits;
-                tobits -= to;
-                from = (to << 6);
-                do
-                {
-                    mvptr->white = bb->white - from + to;
-                    mvptr->black = bb->black;
-                    mvptr->kings = bb->kings - from + to;
-                    mvptr->side = B;
-                    mvptr->moveinfo = 0; /* draw info: it's a king move */
-                    mvptr->parent = bb;  /* link to parent board */
-                    mvptr++;
-                    /* more empty squares beyond? */
-                    to = (to >> 6) & empty;
-                } while (to != 0);
-            }
+    moves_gencalls++;
+    moves_generated += listptr->count;
+}
 
-            tobits = (kings >> 5) & empty; /* ne */
-            while (tobits != 0)
-            {
-                to = tobits & -tobits;
-                tobits -= to;
-                from = (to << 5);
-                do
-                {
-                    mvptr->white = bb->white - from + to;
-                    mvptr->black = bb->black;
-                    mvptr->kings = bb->kings - from + to;
-                    mvptr->side = B;
-                    mvptr->moveinfo = 0; /* draw info: it's a king move */
-                    mvptr->parent = bb;  /* link to parent board */
-                    mvptr++;
-                    /* more empty squares beyond? */
-                    to = (to >> 5) & empty;
-                } while (to != 0);
-            }
+/* generate the non-capture moves only */
+/* bb -> current board, on which no capture is possible */
+/* listptr -> compact move list structure to be constructed */
+HOTPATH
+void gen_cmoves_noncapt(bitboard *bb, cmovelist *listptr)
+{
+    genstate gs;
 
-            tobits = (kings << 5) & empty; /* sw */
-            while (tobits != 0)
-            {
-                to = tobits & -tobits;
-                tobits -= to;
-                from = (to >> 5);
-                do
-                {
-                    mvptr->white = bb->white - from + to;
-                    mvptr->black = bb->black;
-                    mvptr->kings = bb->kings - from + to;
-                    mvptr->side = B;
-                    mvptr->moveinfo = 0; /* draw info: it's a king move */
-                    mvptr->parent = bb;  /* link to parent board */
-                    mvptr++;
-                    /* more empty squares beyond? */
-                    to = (to << 5) & empty;
-                } while (to != 0);
-            }
+    listptr->count = 0;
+    listptr->npcapt = 0;
+    gs.list = listptr;
+    gs.lnptr = NULL;
+    if (bb->side == W)
+    {
+        genmoves_noncapt(bb, &gs, W);
+    }
+    else
+    {
+        genmoves_noncapt(bb, &gs, B);
+    }
 
-            tobits = (kings << 6) & empty; /* se */
-            while (tobits != 0)
-            {
-                to = tobits & -tobits;
-                tobits -= to;
-                from = (to >> 6);
-                do
-                {
-                    mvptr->white = bb->white - from + to;
-                    mvptr->black = bb->black;
-                    mvptr->kings = bb->kings - from + to;
-                    mvptr->side = B;
-                    mvptr->moveinfo = 0; /* draw info: it's a king move */
-                    mvptr->parent = bb;  /* link to parent board */
-                    mvptr++;
-                    /* more empty squares beyond? */
-                    to = (to << 6) & empty;
-                } while (to != 0);
-            }
-        }
+    moves_gencalls++;
+    moves_generated += listptr->count;
+}
+
+#ifdef HAVE_BMI2
+/* look up the attack set of a king along a ray */
+/* d = direction index, see kingshift */
+/* pos = bit position of the king */
+/* occ = occupied positions */
+/* returns: squares on the ray up to and including the first occupied one */
+__inline__ TARGET_BMI2
+static u64 kingatt_bmi2(int d, int pos, u64 occ)
+{
+    return kingrays[d][pos].att[_pext_u64(occ, kingrays[d][pos].mask)];
+}
+
+/* check if any king can capture, as has_kingcapt, using table lookups */
+/* kings = positions of the kings */
+/* empty = empty positions */
+/* opp = opponent pieces */
+/* returns: TRUE if a king capture exists */
+TARGET_BMI2
+static bool has_kingcapt_bmi2(u64 kings, u64 empty, u64 opp)
+{
+    u64 occ, land;
+    int pos;
+
+    occ = ~empty;
+    land = 0;
+    for (; kings != 0; kings &= kings - 1)
+    {
+        /* the first piece on each ray, if an opponent, */
+        /* and the square beyond it */
+        pos = __builtin_ctzll(kings);
+        land |= ((kingatt_bmi2(0, pos, occ) & opp) >> 6) |
+                ((kingatt_bmi2(1, pos, occ) & opp) >> 5) |
+                ((kingatt_bmi2(2, pos, occ) & opp) << 5) |
+                ((kingatt_bmi2(3, pos, occ) & opp) << 6);
+    }
+    return (land & empty) != 0;
+}
+
+/* count the non-capture king moves, using table lookups */
+/* kings = positions of the kings */
+/* empty = empty positions */
+/* returns: nr. of non-capture king moves */
+TARGET_BMI2
+static int kingcount_bmi2(u64 kings, u64 empty)
+{
+    int pos, n;
+
+    n = 0;
+    for (; kings != 0; kings &= kings - 1)
+    {
+        pos = __builtin_ctzll(kings);
+        n += popcount((kingatt_bmi2(0, pos, ~empty) |
+                       kingatt_bmi2(1, pos, ~empty) |
+                       kingatt_bmi2(2, pos, ~empty) |
+                       kingatt_bmi2(3, pos, ~empty)) & empty);
+    }
+    return n;
+}
+#endif
+
+/* upper bound of the nr. of pieces that any capture can take */
+/* an opponent piece can only be jumped along a diagonal if both */
+/* neighbouring squares on it are empty, or hold own pieces (the */
+/* captor's square is vacated); no recursion into capture sequences */
+/* bb -> current board */
+/* returns: the bound, 0 means that no capture is possible */
+HOTPATH
+int capt_bound(bitboard *bb)
+{
+    u64 open, opp;
+
+    if (bb->side == W)
+    {
+        open = ALL50 - bb->black;
+        opp = bb->black;
+    }
+    else
+    {
+        open = ALL50 - bb->white;
+        opp = bb->white;
+    }
+    return popcount(opp & (((open << 6) & (open >> 6)) |
+                           ((open << 5) & (open >> 5))));
+}
+
+/* check if any man of the side to move can capture */
+/* bb -> current board */
+/* returns: TRUE if a man capture exists */
+bool has_mancapt(bitboard *bb)
+{
+    u64 empty, men, opp;
+
+    empty = ALL50 - bb->white - bb->black;
+    if (bb->side == W)
+    {
+        men = bb->white & ~bb->kings;
+        opp = bb->black;
     }
     else
     {
         men = bb->black & ~bb->kings;
+        opp = bb->white;
+    }
 
-        /* for each 'south' direction, find the set of */
-        /* black men that have an adjacent empty square */
+    /* same fell swoop per direction as genmoves_capt */
+    return (((men >> 12) & (opp >> 6) & empty) |
+            ((men >> 10) & (opp >> 5) & empty) |
+            ((men << 10) & (opp << 5) & empty) |
+            ((men << 12) & (opp << 6) & empty)) != 0;
+}
+
+/* find the squares on which a capture by a king in one direction */
+/* would land, for all kings at once */
+/* kings = positions of the kings */
+/* shift = direction, as in addlist_noncapt */
+/* empty = empty positions */
+/* opp = opponent pieces */
+/* returns: landing squares of the first jump, 0 if none */
+__inline__
+static u64 kingcapt_dir(u64 kings, int shift, u64 empty, u64 opp)
+{
+    u64 reach, next;
+
+    /* slide along the leading empty squares */
+    reach = kings;
+    next = kings;
+    do
+    {
+        next = ((shift > 0) ? (next >> shift) : (next << -shift)) & empty;
+        reach |= next;
+    } while (next != 0);
+
+    /* an opponent piece next to them, followed by an empty square? */
+    next = ((shift > 0) ? (reach >> shift) : (reach << -shift)) & opp;
+    return ((shift > 0) ? (next >> shift) : (next << -shift)) & empty;
+}
+
+/* check if any king of the side to move can capture */
+/* bb -> current board */
+/* returns: TRUE if a king capture exists */
+HOTPATH
+bool has_kingcapt(bitboard *bb)
+{
+    u64 empty, kings, opp;
+
+    if (bb->side == W)
+    {
+        kings = bb->white & bb->kings;
+        opp = bb->black;
+    }
+    else
+    {
+        kings = bb->black & bb->kings;
+        opp = bb->white;
+    }
+    /* the sliding below costs more than the bound */
+    if (kings == 0 || capt_bound(bb) == 0)
+    {
+        return FALSE;
+    }
+
+    empty = ALL50 - bb->white - bb->black;
+#ifdef HAVE_BMI2
+    if (use_bmi2)
+    {
+        return has_kingcapt_bmi2(kings, empty, opp);
+    }
+#endif
+    return (kingcapt_dir(kings, 6, empty, opp) |
+            kingcapt_dir(kings, 5, empty, opp) |
+            kingcapt_dir(kings, -5, empty, opp) |
+            kingcapt_dir(kings, -6, empty, opp)) != 0;
+}
 
-        tobits = (men << 5) & empty; /* sw */
-        while (tobits != 0)
+/* check if the side to move has a capture, which it must play */
+/* bb -> current board */
+/* returns: TRUE if a capture exists */
+bool has_capt(bitboard *bb)
+{
+    return has_mancapt(bb) || has_kingcapt(bb);
+}
+
+/* count the non-capture moves, without generating them */
+/* bb -> current board */
+/* returns: nr. of non-capture moves */
+HOTPATH
+int count_noncapt(bitboard *bb)
+{
+    u64 empty, men, kings, tobits;
+    int n;
+
+    empty = ALL50 - bb->white - bb->black;
+
+    if (bb->side == W)
+    {
+        men = bb->white & ~bb->kings;
+        n = popcount((men >> 6) & empty) + popcount((men >> 5) & empty);
+        kings = bb->white & bb->kings;
+    }
+    else
+    {
+        men = bb->black & ~bb->kings;
+        n = popcount((men << 5) & empty) + popcount((men << 6) & empty);
+        kings = bb->black & bb->kings;
+    }
+
+#ifdef HAVE_BMI2
+    if (kings != 0 && use_bmi2)
+    {
+        n += kingcount_bmi2(kings, empty);
+    }
+    else
+#endif
+    if (kings != 0)
+    {
+        /* per direction, count the empty squares that the kings */
+        /* reach in 1, 2, 3, ... steps */
+        for (tobits = (kings >> 6) & empty; tobits != 0;
+             tobits = (tobits >> 6) & empty)
         {
-            to = tobits & -tobits;
-            tobits -= to;
-            mvptr->white = bb->white;
-            mvptr->black = bb->black - (to >> 5) + to;
-            mvptr->kings = bb->kings | (to & ROW10); /* promotion */
-            mvptr->side = W;
-            mvptr->moveinfo = 1; /* draw info: it's a man move */
-            mvptr->parent = bb;  /* link to parent board */
-            mvptr++;
+            n += popcount(tobits);
         }
-
-        tobits = (men << 6) & empty; /* se */
-        while (tobits != 0)
+        for (tobits = (kings >> 5) & empty; tobits != 0;
+             tobits = (tobits >> 5) & empty)
         {
-            to = tobits & -tobits;
-            tobits -= to;
-            mvptr->white = bb->white;
-            mvptr->black = bb->black - (to >> 6) + to;
-            mvptr->kings = bb->kings | (to & ROW10); /* promotion */
-            mvptr->side = W;
-            mvptr->moveinfo = 1; /* draw info: it's a man move */
-            mvptr->parent = bb;  /* link to parent board */
-            mvptr++;
+            n += popcount(tobits);
         }
-
-        kings = bb->black & bb->kings;
-        if (kings != 0)
+        for (tobits = (kings << 5) & empty; tobits != 0;
+             tobits = (tobits << 5) & empty)
+        {
+            n += popcount(tobits);
+        }
+        for (tobits = (kings << 6) & empty; tobits != 0;
+             tobits = (tobits << 6) & empty)
         {
-            /* for each direction, find the set of black kings */
-            /* that have an adjacent empty square */
+            n += popcount(tobits);
+        }
+    }
+    return n;
+}
 
-            tobits = (kings >> 6) & empty; /* nw */
-            while (tobits != 0)
-            {
-                to = tobits & -tobits;
-                tobits -= to;
-                from = (to << 6);
-                do
-                {
-                    mvptr->white = bb->white;
-                    mvptr->black = bb->black - from + to;
-                    mvptr->kings = bb->kings - from + to;
-                    mvptr->side = W;
-                    mvptr->moveinfo = 0; /* draw info: it's a king move */
-                    mvptr->parent = bb;  /* link to parent board */
-                    mvptr++;
-                    /* more empty squares beyond? */
-                    to = (to >> 6) & empty;
-                } while (to != 0);
-            }
+/* construct a compact non-capture move from a from/to pair, if it's valid */
+/* (it's not checked that captures are absent, the caller knows that) */
+/* bb -> current board */
+/* fromto = from/to pair, as produced by cmove_square */
+/* out: mvptr -> the compact move */
+/* returns: TRUE if the move is a valid non-capture move on this board */
+bool noncapt_cmove(bitboard *bb, int fromto, cmove *mvptr)
+{
+    static const int dirs[4] = { -6, -5, 5, 6 };
+    u64 from, to, own, empty, bit;
+    int fromsq, tosq, diff, piece, i;
 
-            tobits = (kings >> 5) & empty; /* ne */
-            while (tobits != 0)
-            {
-                to = tobits & -tobits;
-                tobits -= to;
-                from = (to << 5);
-                do
-                {
-                    mvptr->white = bb->white;
-                    mvptr->black = bb->black - from + to;
-                    mvptr->kings = bb->kings - from + to;
-                    mvptr->side = W;
-                    mvptr->moveinfo = 0; /* draw info: it's a king move */
-                    mvptr->parent = bb;  /* link to parent board */
-                    mvptr++;
-                    /* more empty squares beyond? */
-                    to = (to >> 5) & empty;
-                } while (to != 0);
-            }
+    fromsq = fromto/51;
+    tosq = fromto%51;
+    if (fromsq < 1 || fromsq > 50 || tosq < 1)
+    {
+        return FALSE;
+    }
+    from = conv_to_bit(fromsq);
+    to = conv_to_bit(tosq);
+    own = (bb->side == W) ? bb->white : bb->black;
+    empty = ALL50 - bb->white - bb->black;
+    if ((from & own) == 0 || (to & empty) == 0)
+    {
+        return FALSE;
+    }
 
-            tobits = (kings << 5) & empty; /* sw */
-            while (tobits != 0)
+    piece = 2*bb->side + ((bb->kings & from) != 0); /* MW/KW/MB/KB */
+    diff = __builtin_ctzll(to) - __builtin_ctzll(from);
+    if ((piece & K) == M)
+    {
+        /* white men move north (-5, -6), black men south (+5, +6) */
+        if ((bb->side == W) ? (diff != -5 && diff != -6) :
+                              (diff != 5 && diff != 6))
+        {
+            return FALSE;
+        }
+    }
+    else
+    {
+        /* a king moves along a diagonal of empty squares */
+        for (i = 0; i < 4; i++)
+        {
+            if (diff % dirs[i] == 0 && diff / dirs[i] > 0)
             {
-                to = tobits & -tobits;
-                tobits -= to;
-                from = (to >> 5);
+                bit = from;
                 do
                 {
-                    mvptr->white = bb->white;
-                    mvptr->black = bb->black - from + to;
-                    mvptr->kings = bb->kings - from + to;
-                    mvptr->side = W;
-                    mvptr->moveinfo = 0; /* draw info: it's a king move */
-                    mvptr->parent = bb;  /* link to parent board */
-                    mvptr++;
-                    /* more empty squares beyond? */
-                    to = (to << 5) & empty;
-                } while (to != 0);
-            }
-
-            tobits = (kings << 6) & empty; /* se */
-            while (tobits != 0)
-            {
-                to = tobits & -tobits;
-                tobits -= to;
-                from = (to >> 6);
-                do
+                    bit = (dirs[i] < 0) ? (bit >> -dirs[i]) : (bit << dirs[i]);
+                } while (bit != to && (bit & empty) != 0);
+                if (bit == to)
                 {
-                    mvptr->white = bb->white;
-                    mvptr->black = bb->black - from + to;
-                    mvptr->kings = bb->kings - from + to;
-                    mvptr->side = W;
-                    mvptr->moveinfo = 0; /* draw info: it's a king move */
-                    mvptr->parent = bb;  /* link to parent board */
-                    mvptr++;
-                    /* more empty squares beyond? */
-                    to = (to << 6) & empty;
-                } while (to != 0);
+                    break;
+                }
             }
         }
+        if (i == 4)
+        {
+            return FALSE;
+        }
     }
 
-    /* update the count of moves found */
-    listptr->count = (int) (mvptr - listptr->move);
+    mvptr->capt = 0;
+    mvptr->from = (u8) __builtin_ctzll(from);
+    mvptr->to = (u8) __builtin_ctzll(to);
+    mvptr->piece = (u8) piece;
+    mvptr->newpiece = (u8) (piece |
+                      ((to & ((bb->side == W) ? ROW1 : ROW10)) != 0));
+    /* draw info: man move = 1, king move = 0 */
+    mvptr->moveinfo = (u8) ((piece & K) == M);
+    return TRUE;
+}
 
-    /* provide long notations if requested */
-    if (listptr->lnptr != NULL)
+/* initialize the move generator: select the BMI2 path of count_noncapt */
+/* and has_kingcapt if the cpu supports it, and build its tables; */
+/* without this call, or on other cpus, the portable path is used */
+/* returns: name of the selected path */
+char *init_movegen(void)
+{
+#ifdef HAVE_BMI2
+    u64 bit, ray, mask, occ, att;
+    int d, pos, n, i, j, ofs;
+
+    if (!__builtin_cpu_supports("bmi2"))
+    {
+        return "portable";
+    }
+
+    ofs = 0;
+    for (d = 0; d < 4; d++)
     {
-        for (m = 0; m < listptr->count; m++)
+        for (pos = 0; pos < 64; pos++)
         {
-            if (bb->side == W)
+            if (((1ULL << pos) & ALL50) == 0)
             {
-                listptr->lnptr[m].square[0] = 
-                    conv_to_square(bb->white & ~listptr->move[m].white);
-                listptr->lnptr[m].square[1] = 
-                    conv_to_square(listptr->move[m].white & ~bb->white);
+                continue;
             }
-            else
+            /* the squares along the ray */
+            ray = 0;
+            mask = 0;
+            bit = 1ULL << pos;
+            while ((bit = ((kingshift[d] > 0) ? (bit >> kingshift[d]) :
+                           (bit << -kingshift[d])) & ALL50) != 0)
             {
-                listptr->lnptr[m].square[0] = 
-                    conv_to_square(bb->black & ~listptr->move[m].black);
-                listptr->lnptr[m].square[1] = 
-                    conv_to_square(listptr->move[m].black & ~bb->black);
+                ray |= bit;
+                mask = bit;
             }
-            listptr->lnptr[m].square[2] = 0; /* terminator */
+            /* leave out the last square */
+            mask = (ray != 0) ? ray ^ mask : 0;
+            n = popcount(mask);
+            kingrays[d][pos].mask = mask;
+            kingrays[d][pos].att = &kingatt[ofs];
+
+            /* for each occupancy of the masked squares, */
+            /* i.e. for each possible PEXT index */
+            for (i = 0; i < (1 << n); i++)
+            {
+                /* deposit the index bits on the mask */
+                occ = 0;
+                for (bit = mask, j = 0; bit != 0; bit &= bit - 1, j++)
+                {
+                    if ((i >> j) & 1)
+                    {
+                        occ |= bit & -bit;
+                    }
+                }
+                /* walk the ray up to the first occupied square */
+                att = 0;
+                bit = 1ULL << pos;
+                while ((bit = ((kingshift[d] > 0) ? (bit >> kingshift[d]) :
+                               (bit << -kingshift[d])) & ray) != 0)
+                {
+                    att |= bit;
+                    if ((bit & occ) != 0)
+                    {
+                        break;
+                    }
+                }
+                kingatt[ofs + i] = att;
+            }
+            ofs += 1 << n;
         }
     }
+    use_bmi2 = TRUE;
+    return "bmi2";
+#else
+    return "portable";
+#endif
+}
+
+/* generate the moves for the current bitboard position */
+/* the moves in the list are compact, see make_move */
+/* bb -> current board */
+/* listptr -> compact move list structure to be constructed */
+/* genall = if TRUE, generate all valid moves including non-captures */
+/*          if FALSE, generate captures only */
+HOTPATH
+void gen_cmoves(bitboard *bb, cmovelist *listptr, bool genall)
+{
+    gen_list(bb, listptr, NULL, genall);
+}
+
+/* construct the bitboard resulting from a compact move */
+/* bb -> current board */
+/* mvptr -> the compact move */
+/* child -> resulting board, linked to the current board */
+void make_move(bitboard *bb, cmove *mvptr, bitboard *child)
+{
+    u64 from, to, capt, captbit, mover, hash;
+    int opp;
+
+    from = 1ULL << mvptr->from;
+    to = 1ULL << mvptr->to;
+    capt = mvptr->capt;
+    mover = from ^ to; /* zero when from=to */
+
+    if (bb->side == W)
+    {
+        child->white = bb->white ^ mover;
+        child->black = bb->black ^ capt;
+    }
+    else
+    {
+        child->white = bb->white ^ capt;
+        child->black = bb->black ^ mover;
+    }
+    /* remove any captured kings and update moving piece */
+    child->kings = (bb->kings & ~(capt | from)) |
+                   (to & -(u64) (mvptr->newpiece & K));
+    child->side = bb->side ^ 1;
+
+    /* update zobrist hash for the moving piece, which may have promoted */
+    hash = bb->hash ^ zobrist[mvptr->piece][mvptr->from]
+        ^ zobrist[mvptr->newpiece][mvptr->to];
+    /* and for the captured pieces */
+    opp = 2 - 2*bb->side; /* MB or MW */
+    while (capt != 0)
+    {
+        captbit = capt & -capt;
+        capt -= captbit;
+        hash ^= zobrist[opp + ((bb->kings & captbit) != 0)]
+                       [__builtin_ctzll(captbit)];
+    }
+    child->hash = hash;
+
+    child->moveinfo = mvptr->moveinfo;
+    child->parent = bb; /* link to parent board */
 }
 
 /* generate the moves for the current bitboard position */
@@ -807,19 +1175,20 @@ static void genmoves_noncapt(bitboard *bb, movelist *listptr)
 /* lnptr -> long notation array to be constructed, or NULL */
 /* genall = if TRUE, generate all valid moves including non-captures */
 /*          if FALSE, generate captures only */
+HOTPATH
 void gen_moves(bitboard *bb, movelist *listptr, lnlist *lnptr, bool genall)
 {
-    listptr->count = 0;
-    listptr->npcapt = 0;
+    cmovelist clist;
+    int m;
+
+    gen_list(bb, &clist, (lnentry *) lnptr, genall);
+
+    listptr->count = clist.count;
+    listptr->npcapt = clist.npcapt;
     listptr->lnptr = (lnentry *) lnptr;
     listptr->bb = bb;
-    genmoves_capt(bb, listptr);
-
-    if (genall && listptr->count == 0)
+    for (m = 0; m < clist.count; m++)
     {
-        genmoves_noncapt(bb, listptr);
+        make_move(bb, &clist.move[m], &listptr->move[m]);
     }
-
-    moves_gencalls++;
-    moves_generated += listptr->count;
 }
@@ -24,6 +24,7 @@ typedef struct bb {
     u32 side;           /* side to move, W or B */
     u32 moveinfo;       /* additional move info */
     struct bb *parent;  /* ptr to previous board in the tree */
+    u64 hash;           /* zobrist hash of the pieces (not the side) */
 } bitboard;
 
 typedef struct {
@@ -37,17 +38,41 @@ typedef struct {
 typedef struct {
     int count;          /* number of moves generated */
     int npcapt;         /* number of pieces captured in each move */
-    u64 frombit;        /* during movegen: starting position of captor */
-    u64 empty;          /* during movegen: empty positions, including frombit */
-    u64 oppbits;        /* during movegen: opponents at start of capture */
-    u64 tp[32];         /* during movegen: turning points of capture */
     bitboard *bb;       /* ptr to old board */
     lnentry *lnptr;     /* ptr to long notation array */
     bitboard move[128]; /* the new boards resulting from the moves */
 } movelist;
 
+/* a compact move only holds what changes on the board; */
+/* make_move materializes the resulting bitboard when it's needed */
+typedef struct {
+    u64 capt;           /* bit positions of captured pieces */
+    u8 from;            /* bit position of the moving piece */
+    u8 to;              /* bit position it arrives at (may be equal to from) */
+    u8 piece;           /* type of the moving piece, MW/KW/MB/KB */
+    u8 newpiece;        /* type after the move, differs on promotion */
+    u8 moveinfo;        /* draw info for the resulting board */
+    u8 unused[3];
+} cmove;
+
+typedef struct {
+    int count;          /* number of moves generated */
+    int npcapt;         /* number of pieces captured in each move */
+    cmove move[128];    /* the compact moves */
+} cmovelist;
+
 /* statistics */
-extern u64 moves_gencalls;     /* nr. of move generator calls made */
-extern u64 moves_generated;    /* nr. of moves generated */
+extern THREADLOCAL u64 moves_gencalls;     /* nr. of move generator calls made */
+extern THREADLOCAL u64 moves_generated;    /* nr. of moves generated */
 
+extern char *init_movegen(void);
 extern void gen_moves(bitboard *bb, movelist *listptr, lnlist *lnptr, bool genall);
+extern void gen_cmoves(bitboard *bb, cmovelist *listptr, bool genall);
+extern void gen_cmoves_noncapt(bitboard *bb, cmovelist *listptr);
+extern int count_noncapt(bitboard *bb);
+extern int capt_bound(bitboard *bb);
+extern bool has_mancapt(bitboard *bb);
+extern bool has_kingcapt(bitboard *bb);
+extern bool has_capt(bitboard *bb);
+extern bool noncapt_cmove(bitboard *bb, int fromto, cmove *mvptr);
+extern void make_move(bitboard *bb, cmove *mvptr, bitboard *child);
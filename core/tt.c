@@ -21,61 +21,580 @@
 
 #include "core.h"
 
-ttentry *trans_tbl;   /* the transposition table */
-u32 tt_mask;          /* masking unused addressing bits and slot selection */
+#ifndef _WIN32
+#ifndef MPOL_INTERLEAVE
+#define MPOL_INTERLEAVE 3     /* memory policy, as in <numaif.h> */
+#endif
+#endif
+
+typedef struct {              /* work for a tt wipe thread */
+    thrd handle;
+    u64 first;                /* first bucket to wipe */
+    u64 count;                /* nr. of buckets to wipe */
+} wipethrd;
+
+ttbucket *trans_tbl;  /* the transposition table */
+u64 tt_mask;          /* masking unused bucket addressing bits */
 u64 hash_init;        /* initializer for hash function */
+u32 tt_generation;    /* generation of new entries, one per search */
+int tt_wipers;        /* nr. of threads used to wipe the table */
+ttheader *tt_filehdr; /* header of the memory-mapped tt file, or NULL */
+
+/* fill in a tt file header for the current table */
+/* out: hp -> header */
+static void fill_header(ttheader *hp)
+{
+    memset(hp, 0, sizeof(ttheader));
+    memcpy(hp->magic, TTMAGIC, sizeof hp->magic);
+    hp->version = TTVERSION;
+    hp->slots = TTSLOTS;
+    hp->buckets = tt_mask + 1;
+    hp->hash_init = hash_init;
+    hp->generation = tt_generation;
+}
+
+/* check a tt file header against the current table */
+/* hp -> header */
+/* buckets = nr. of buckets of the current table */
+/* returns: TRUE if the file's entries can be used */
+static bool check_header(ttheader *hp, u64 buckets)
+{
+    return memcmp(hp->magic, TTMAGIC, sizeof hp->magic) == EQUAL &&
+           hp->version == TTVERSION && hp->slots == TTSLOTS &&
+           hp->buckets == buckets;
+}
+
+/* clear the stale entries in a slice of the transposition table */
+/* only the 6 lsb's of the generation are kept in an entry, so after */
+/* TTGENMASK + 1 generations an old entry would look current again; */
+/* each new generation clears the entries that are TTSTALE or more */
+/* generations old in one of TTSLICES slices, so that every slot is */
+/* checked before its age can wrap */
+/* slice = slice number, 0..TTSLICES - 1 */
+static void clear_stale(int slice)
+{
+    u64 buckets, b;
+    u64 word;
+    int i;
+
+    buckets = (tt_mask + 1)/TTSLICES;
+    for (b = buckets*slice; b < buckets*(slice + 1); b++)
+    {
+        for (i = 0; i < TTSLOTS; i++)
+        {
+            word = trans_tbl[b].word[i];
+            if (word != 0 &&
+                ((tt_generation - (u32)(word >> TTGENSHIFT)) & TTGENMASK) >=
+                TTSTALE)
+            {
+                trans_tbl[b].word[i] = 0;
+                trans_tbl[b].check[i] = 0;
+            }
+        }
+    }
+}
+
+/* advance the generation of new entries */
+/* step = nr. of generations to advance */
+static void next_generation(u32 step)
+{
+    u32 gen, g;
+
+    if (tt_filehdr != NULL)
+    {
+        /* other processes may share the table and its generation, */
+        /* each clears the slices of the generations it adds */
+        gen = atomic_add32(&tt_filehdr->generation, step);
+    }
+    else
+    {
+        gen = tt_generation + step;
+    }
+    tt_generation = gen & TTGENMASK;
+    for (g = gen - step + 1; g != gen + 1; g++)
+    {
+        clear_stale(g % TTSLICES);
+    }
+}
 
 /* flush transposition table */
-/* it gets a new initial value for the hash function, */
-/* thus no need to zero out the whole table */
+/* the entries stay valid, and may still give hits in the new game, */
+/* but they get an older generation, so they are the first to be */
+/* replaced */
 void flush_tt(void)
 {
-    hash_init  = (u64)rand();
-    hash_init += (u64)rand() << 32;
+    next_generation(TTGENMASK/4);
+}
+
+/* start a new generation of tt entries */
+/* to be called at the start of each search */
+void age_tt(void)
+{
+    next_generation(1);
+}
+
+/* estimate how full the tt is with entries from the current search */
+/* returns: permille of sampled slots holding a current generation entry */
+int hashfull_tt(void)
+{
+    u64 word;
+    int i, n;
+
+    n = 0;
+    for (i = 0; i < 1000; i++)
+    {
+        word = trans_tbl[i/TTSLOTS].word[i%TTSLOTS];
+        if (word != 0 &&
+            ((word >> TTGENSHIFT) & TTGENMASK) == tt_generation)
+        {
+            n++;
+        }
+    }
+    return n;
+}
+
+/* wipe thread main function */
+/* arg -> the part of the table to wipe */
+/* returns: NULL */
+static void *wipe_part(void *arg)
+{
+    wipethrd *wp = (wipethrd *) arg;
+
+    memset(&trans_tbl[wp->first], 0, wp->count*sizeof(ttbucket));
+    return NULL;
 }
 
 /* wipe transposition table */
 /* use instead of flush_tt for somewhat reproducible timing tests */
+/* the table is divided over tt_wipers threads; the first wipe also */
+/* commits the memory, so each thread touches its own part first */
 void wipe_tt(void)
 {
-    u32 i;
+    wipethrd wipe[MAXWIPERS];
+    u64 buckets;
+    int t, n;
 
-    for (i = 0; i < tt_mask + 4; i++)
+    buckets = tt_mask + 1;
+    n = tt_wipers;
+    for (t = 0; t < n; t++)
     {
-        trans_tbl[i].ttsig = 0;
+        wipe[t].first = buckets*t/n;
+        wipe[t].count = buckets*(t + 1)/n - wipe[t].first;
+        if (t > 0 && !start_thread(&wipe[t].handle, wipe_part, &wipe[t]))
+        {
+            wipe_part(&wipe[t]); /* do it ourselves */
+            wipe[t].count = 0;
+        }
+    }
+    wipe_part(&wipe[0]);
+    for (t = 1; t < n; t++)
+    {
+        if (wipe[t].count != 0)
+        {
+            join_thread(wipe[t].handle);
+        }
     }
-    printf("wiped tt with %u entries\n", i);
+    printf("wiped tt with %" PRIu64 " entries using %d threads\n",
+           buckets*TTSLOTS, n);
     hash_init = 0x0ecf2aaef2c937b6ULL;
+    if (tt_filehdr != NULL)
+    {
+        fill_header(tt_filehdr);
+    }
+}
+
+/* allocate the memory for the transposition table */
+/* size = nr. of bytes */
+/* interleave = spread the memory over all numa nodes */
+/* returns: ptr to memory aligned on cache line boundary, or NULL */
+static void *alloc_tt(u64 size, bool interleave)
+{
+#ifdef _WIN32
+    return _aligned_malloc(size, 64);
+#else
+    void *mem = MAP_FAILED;
+    unsigned long nodemask = ~0UL;
+
+#ifdef MAP_HUGETLB
+    /* prefer explicit huge pages, to get fewer tlb misses */
+    mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (mem != MAP_FAILED)
+    {
+        printf("tt uses explicit huge pages\n");
+    }
+#endif
+    if (mem == MAP_FAILED)
+    {
+        /* no huge pages reserved, ask for transparent huge pages */
+        mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED)
+        {
+            return NULL;
+        }
+#ifdef MADV_HUGEPAGE
+        if (madvise(mem, size, MADV_HUGEPAGE) == 0)
+        {
+            printf("tt uses transparent huge pages\n");
+        }
+#endif
+    }
+    if (interleave)
+    {
+#ifdef SYS_mbind
+        /* the kernel reduces the node mask to the nodes available */
+        if (syscall(SYS_mbind, mem, size, MPOL_INTERLEAVE,
+                    &nodemask, 8*sizeof nodemask, 0) == 0)
+        {
+            printf("tt memory interleaved over numa nodes\n");
+        }
+        else
+#endif
+        {
+            printf("tt numa interleave not available\n");
+        }
+    }
+    return mem;
+#endif
+}
+
+/* map a tt file or named shared memory segment into memory, */
+/* to be used directly as the table */
+/* a file is created or resized as needed, a shared memory segment */
+/* is created, or attached to if another process created it already */
+/* name -> name of the tt file or shared memory segment */
+/* shared = name is a shared memory segment */
+/* size = nr. of bytes, including the header */
+/* out: validptr -> TRUE if the file already held a matching table */
+/* returns: ptr to the mapped header, or NULL */
+static ttheader *map_tt(char *name, bool shared, u64 size, bool *validptr)
+{
+    ttheader *hp;
+#ifdef _WIN32
+    HANDLE hf, hmap;
+    LARGE_INTEGER filesize;
+
+    if (shared)
+    {
+        /* backed by the paging file, lives as long as a process uses it */
+        hmap = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                                 (DWORD)(size >> 32), (DWORD)size, name);
+        *validptr = (GetLastError() == ERROR_ALREADY_EXISTS);
+    }
+    else
+    {
+        hf = CreateFile(name, GENERIC_READ | GENERIC_WRITE, 0, NULL,
+                        OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (hf == INVALID_HANDLE_VALUE)
+        {
+            printf("map_tt: %s can't open\n", name);
+            return NULL;
+        }
+        *validptr = GetFileSizeEx(hf, &filesize) &&
+                    filesize.QuadPart == size;
+        hmap = CreateFileMapping(hf, NULL, PAGE_READWRITE,
+                                 (DWORD)(size >> 32), (DWORD)size, NULL);
+        CloseHandle(hf); /* the mapping keeps the file open */
+    }
+    if (hmap == NULL)
+    {
+        printf("map_tt: %s CreateFileMapping failed\n", name);
+        return NULL;
+    }
+    hp = (ttheader *) MapViewOfFile(hmap, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    CloseHandle(hmap); /* the view keeps the mapping open */
+    if (hp == NULL)
+    {
+        printf("map_tt: %s MapViewOfFile failed\n", name);
+        return NULL;
+    }
+#else
+    struct stat statbuf;
+    int fd;
+
+    if (shared)
+    {
+        fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+    }
+    else
+    {
+        fd = open(name, O_RDWR | O_CREAT, 0644);
+    }
+    if (fd == -1)
+    {
+        printf("map_tt: %s can't open\n", name);
+        return NULL;
+    }
+    if (fstat(fd, &statbuf) != 0)
+    {
+        statbuf.st_size = 0;
+    }
+    *validptr = ((u64)statbuf.st_size == size);
+    if (shared && !*validptr && statbuf.st_size != 0)
+    {
+        /* resizing would pull the table away from the other processes */
+        printf("map_tt: %s in use with other tt size\n", name);
+        close(fd);
+        return NULL;
+    }
+    if (!*validptr && ftruncate(fd, size) != 0)
+    {
+        printf("map_tt: %s can't resize\n", name);
+        close(fd);
+        return NULL;
+    }
+    hp = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); /* the mapping keeps the file open */
+    if (hp == MAP_FAILED)
+    {
+        printf("map_tt: %s mmap failed\n", name);
+        return NULL;
+    }
+#ifdef MADV_HUGEPAGE
+    if (shared)
+    {
+        madvise(hp, size, MADV_HUGEPAGE); /* if shmem supports it */
+    }
+#endif
+#endif
+    *validptr = *validptr && check_header(hp, (size - sizeof(ttheader))/
+                                              sizeof(ttbucket));
+    return hp;
 }
 
 /* initialize transposition table */
 /* exp = exponent of transposition table size */
-/*       (nr. of entries is 2^exp) */
+/*       (size is 2^exp * 16 bytes, in buckets of 64 bytes) */
+/* nthreads = nr. of threads to use for wiping the table */
+/* interleave = spread the table over all numa nodes */
+/* name -> tt file or shared memory segment to map as the table, */
+/*         or NULL for plain memory */
+/* shared = name is a shared memory segment, to share the table */
+/*          with other processes */
 /* returns: TRUE if successful */
-bool init_tt(u32 exp)
+bool init_tt(u32 exp, int nthreads, bool interleave, char *name, bool shared)
 {
-    u32 ttentries;
+    u64 ttbuckets;
+    bool valid = FALSE;
 
-    ttentries = (1 << exp);
-    /* align on cache line boundary to improve performance */
-#ifdef _WIN32
-    trans_tbl = _aligned_malloc(ttentries*sizeof(ttentry), 64);
+    ttbuckets = (1ULL << (exp - 2));
+    if (name != NULL)
+    {
+        /* the page-aligned header keeps the buckets on cache lines */
+        tt_filehdr = map_tt(name, shared, sizeof(ttheader) +
+                                  ttbuckets*sizeof(ttbucket), &valid);
+        trans_tbl = (tt_filehdr == NULL) ? NULL : (ttbucket *)(tt_filehdr + 1);
+    }
+    else
+    {
+        /* one bucket per cache line */
+        trans_tbl = alloc_tt(ttbuckets*sizeof(ttbucket), interleave);
+    }
     if (trans_tbl == NULL)
-#else
-    if (posix_memalign((void **)&trans_tbl, 64, ttentries*sizeof(ttentry)) != 0)
-#endif
     {
         return FALSE;
     }
-    /* mask's 2 lsb's are zero, to have 4 slots per bucket (1 cache line) */
-    tt_mask = ttentries - 4;
-    printf("created tt with %u entries (2^%u), size=%uMiB\n",
-           ttentries, exp, (1 << (exp - 20))*(u32)sizeof(ttentry));
+    tt_mask = ttbuckets - 1;
+    tt_wipers = max(1, min(nthreads, MAXWIPERS));
+    printf("created tt with %" PRIu64 " entries (2^%u*%d/4), size=%" PRIu64
+           "MiB\n", ttbuckets*TTSLOTS, exp, TTSLOTS,
+           (ttbuckets*sizeof(ttbucket)) >> 20);
+    if (valid)
+    {
+        /* continue with the entries in the file or shared segment */
+        hash_init = tt_filehdr->hash_init;
+        tt_generation = tt_filehdr->generation & TTGENMASK;
+        printf("using entries of tt %s %s, hashfull=%d\n",
+               shared ? "segment" : "file", name, hashfull_tt());
+        return TRUE;
+    }
     /* force os to commit the memory now */
     wipe_tt();
     return TRUE;
 }
 
+/* save the transposition table to a file */
+/* filename -> name of the file */
+/* returns: TRUE if successful */
+bool save_tt(char *filename)
+{
+    ttheader header;
+    FILE *fp;
+    bool ok;
+
+    fp = fopen(filename, "wb");
+    if (fp == NULL)
+    {
+        printf("save_tt: %s can't open\n", filename);
+        return FALSE;
+    }
+    fill_header(&header);
+    ok = fwrite(&header, sizeof header, 1, fp) == 1 &&
+         fwrite(trans_tbl, sizeof(ttbucket), tt_mask + 1, fp) == tt_mask + 1;
+    if (fclose(fp) != 0 || !ok)
+    {
+        printf("save_tt: %s write error\n", filename);
+        return FALSE;
+    }
+    printf("saved tt with %" PRIu64 " entries to %s\n",
+           (tt_mask + 1)*TTSLOTS, filename);
+    return TRUE;
+}
+
+/* get the size of a file */
+/* filename -> name of the file */
+/* returns: size in bytes, or 0 if unknown */
+static u64 file_size(char *filename)
+{
+#ifdef _WIN32
+    struct _stat64 statbuf;
+
+    if (_stat64(filename, &statbuf) != 0)
+#else
+    struct stat statbuf;
+
+    if (stat(filename, &statbuf) != 0)
+#endif
+    {
+        return 0;
+    }
+    return (u64)statbuf.st_size;
+}
+
+/* load the transposition table from a file made by save_tt */
+/* the file must match the current table size, entry format and hash */
+/* function, and save_tt writes a generation within TTGENMASK; a file */
+/* that doesn't leaves the table untouched, only a read error halfway */
+/* leaves it partly loaded (with valid entries, as the hash is the same) */
+/* filename -> name of the file */
+/* returns: TRUE if successful */
+bool load_tt(char *filename)
+{
+    ttheader header;
+    FILE *fp;
+    bool ok;
+
+    fp = fopen(filename, "rb");
+    if (fp == NULL)
+    {
+        printf("load_tt: %s can't open\n", filename);
+        return FALSE;
+    }
+    if (file_size(filename) !=
+        sizeof header + (tt_mask + 1)*sizeof(ttbucket) ||
+        fread(&header, sizeof header, 1, fp) != 1 ||
+        !check_header(&header, tt_mask + 1) ||
+        header.hash_init != hash_init ||
+        header.generation > TTGENMASK)
+    {
+        printf("load_tt: %s has other tt size or format\n", filename);
+        fclose(fp);
+        return FALSE;
+    }
+    ok = fread(trans_tbl, sizeof(ttbucket), tt_mask + 1, fp) == tt_mask + 1;
+    fclose(fp);
+    if (!ok)
+    {
+        printf("load_tt: %s read error\n", filename);
+        return FALSE;
+    }
+    tt_generation = header.generation & TTGENMASK;
+    if (tt_filehdr != NULL)
+    {
+        fill_header(tt_filehdr);
+    }
+    printf("loaded tt with %" PRIu64 " entries from %s\n",
+           (tt_mask + 1)*TTSLOTS, filename);
+    return TRUE;
+}
+
+/* get the tt key of a board position */
+/* combines the board's zobrist hash with side to move and hash_init */
+/* bb -> board */
+/* returns: 64-bit key; lsb's select the bucket, 20 msb's are the signature */
+__inline__
+static u64 tt_key(bitboard *bb)
+{
+    return bb->hash ^ hash_init ^ (-(u64)bb->side & ZOBSIDE);
+}
+
+/* read a tt slot as one consistent snapshot */
+/* other threads may be storing into the slot at the same time */
+/* bucket -> tt bucket */
+/* i = slot number in bucket */
+/* ttsig = signature to look for */
+/* out: wordptr -> the slot's word */
+/* out: captptr -> the slot's capture hash */
+/* returns: TRUE if slot holds an intact entry with signature ttsig */
+__inline__
+static bool read_slot(ttbucket *bucket, int i, u32 ttsig, u64 *wordptr,
+                      int *captptr)
+{
+    volatile ttbucket *vbucket = bucket;
+    u64 word;
+    u32 check;
+    int capt;
+
+    word = vbucket->word[i];
+    capt = (vbucket->capt >> (TTCAPTBITS*i)) & TTCAPTMASK;
+    check = vbucket->check[i] ^ tt_scramble(word) ^ capt;
+    if (((check << 4) | (u32)(word >> TTSIGSHIFT)) != ttsig)
+    {
+        return FALSE; /* other position, or torn entry */
+    }
+    *wordptr = word;
+    *captptr = capt;
+    return TRUE;
+}
+
+/* write a tt slot, giving it the current generation */
+/* bucket -> tt bucket */
+/* i = slot number in bucket */
+/* ttsig = signature of the position */
+/* word = score, depth, bound flags and best move */
+/* capt = capture hash of the best move */
+__inline__
+static void write_slot(ttbucket *bucket, int i, u32 ttsig, u64 word, int capt)
+{
+    volatile ttbucket *vbucket = bucket;
+    u32 old, new;
+
+    word &= ~((u64)TTGENMASK << TTGENSHIFT);
+    word |= ((u64)tt_generation << TTGENSHIFT) |
+            ((u64)ttsig << TTSIGSHIFT);
+    vbucket->word[i] = word;
+
+    /* the capt field is shared by the slots, other threads may be */
+    /* writing the hash of another slot; mostly it is unchanged */
+    old = vbucket->capt;
+    while (((old >> (TTCAPTBITS*i)) & TTCAPTMASK) != (u32)capt)
+    {
+        new = (old & ~((u32)TTCAPTMASK << (TTCAPTBITS*i))) |
+              ((u32)capt << (TTCAPTBITS*i));
+        if (atomic_cas32(&bucket->capt, old, new))
+        {
+            break; /* out of while loop */
+        }
+        old = vbucket->capt;
+    }
+    vbucket->check[i] = (u16)(ttsig >> 4) ^ tt_scramble(word) ^ capt;
+}
+
+/* determine how valuable it is to keep a slot's entry */
+/* deep entries are worth more, but each search since the entry */
+/* was stored counts as 4 plies less depth */
+/* word = the slot's word */
+/* returns: replacement value, lowest is the first to be replaced */
+__inline__
+static int slot_value(u64 word)
+{
+    int age;
+
+    age = (tt_generation - (u32)(word >> TTGENSHIFT)) & TTGENMASK;
+    return (int)((word >> TTDEPTHSHIFT) & TTDEPTH) - 4*age;
+}
+
 /* probe transposition table for current board position */
 /* bb -> current board */
 /* ply = ply level */
@@ -83,55 +602,55 @@ bool init_tt(u32 exp)
 /* alpha = alpha value */
 /* beta = beta value */
 /* out: scoreptr -> value of position */
-/* out: bestptr -> collapsed best move, or NULL */
+/* out: bestptr -> best move as from/to pair with capture hash */
+/*                 (0 if none), or NULL */
 /* returns: TRUE if found in table */
-bool probe_tt(bitboard *bb, int ply, int depth, s32 alpha, s32 beta, s32 *scoreptr, u64 *bestptr)
+bool probe_tt(bitboard *bb, int ply, int depth, s32 alpha, s32 beta, s32 *scoreptr, int *bestptr)
 {
-    ttentry *ttslot;
+    ttbucket *bucket;
     u32 ttsig;
     s32 score;
-    u64 a, b, c;
-
-    /* scramble board position into a hash */
-    a = bb->white + hash_init;
-    b = bb->black + hash_init;
-    c = bb->kings + 0x9e3779b97f4a7c13ULL; /* "golden ratio", arbitrary value */
-    mix64(a, b, c);
+    u64 key, word;
+    int i, capt;
 
-    ttslot = &trans_tbl[c & tt_mask];
-    ttsig = ((u32)b ^ bb->side);
+    key = tt_key(bb);
+    bucket = &trans_tbl[key & tt_mask];
+    ttsig = (u32)(key >> 44);
 
-    /* check max 4 slots for our signature */
-    /* 4 slots share 1 cache line, so after retrieving the first one */
-    /* from main memory, the other 3 are also cached, and fast to access */
-    if (ttslot[0].ttsig != ttsig)
+    /* check max 6 slots for our signature */
+    /* the bucket is 1 cache line, so after retrieving the first slot */
+    /* from main memory, the others are also cached, and fast to access */
+    for (i = 0; i < TTSLOTS; i++)
     {
-        if (ttslot[1].ttsig != ttsig)
+        if (read_slot(bucket, i, ttsig, &word, &capt))
         {
-            if (ttslot[2].ttsig != ttsig)
-            {
-                if (ttslot[3].ttsig != ttsig)
-                {
-                    return FALSE;
-                }
-                ttslot++;
-            }
-            ttslot++;
+            break; /* out of for loop */
         }
-        ttslot++;
+    }
+    if (i == TTSLOTS)
+    {
+        return FALSE;
     }
 
-    /* give caller the collapsed best move, */
+    /* an entry from an earlier search is still useful, renew its */
+    /* generation so it is not the first to be replaced */
+    if (((word >> TTGENSHIFT) & TTGENMASK) != tt_generation)
+    {
+        write_slot(bucket, i, ttsig, word, capt);
+    }
+    score = (s32)(word & TTSCORE);
+
+    /* give caller the best move, */
     /* to be used for move ordering if depth is insufficient */
     /* (also used to reconstruct and print the pv) */
     if (bestptr != NULL)
     {
-        *bestptr = ttslot->bestmove;
+        *bestptr = (int)((word >> TTMOVESHIFT) & TTMOVEMASK) |
+                   (capt << TTCAPTSHIFT);
     }
 
-    if (ttslot->depth >= depth)
+    if ((int)((word >> TTDEPTHSHIFT) & TTDEPTH) >= depth)
     {
-        score = ttslot->score;
         /* adjust dtw score for root node level */
         if (score > INFIN - MAXEXACT)
         {
@@ -142,7 +661,7 @@ bool probe_tt(bitboard *bb, int ply, int depth, s32 alpha, s32 beta, s32 *scorep
             score += ply;
         }
 
-        if (ttslot->betabound)
+        if (word & TTBETA)
         {
             if (score >= beta)
             {
@@ -156,7 +675,7 @@ bool probe_tt(bitboard *bb, int ply, int depth, s32 alpha, s32 beta, s32 *scorep
                 *scoreptr = score;
             }
         }
-        else if (ttslot->alphabound)
+        else if (word & TTALPHA)
         {
             if (score <= alpha)
             {
@@ -172,64 +691,28 @@ bool probe_tt(bitboard *bb, int ply, int depth, s32 alpha, s32 beta, s32 *scorep
             return TRUE;
         }
     }
-#ifdef PF
-    /* if it is likely that the bestmove's board position */
-    /* will be probed soon, prefetch its tt entry cache line */
-    if (bestptr != NULL && depth > 1)
-    {
-        u64 bestmove = *bestptr;
-
-        /* first, a little sleight of bit to construct the */
-        /* board contents using the collapsed bestmove */
-        if (bb->side == W)
-        {
-            /* remove any captured pieces */
-            b = bb->black & bestmove;
-            /* update moving piece */
-            a = bestmove - b;
-
-            if ((bb->white & bb->kings & ~bestmove) != 0)
-            {
-                /* the moving piece is a king */
-                /* update moving king and remove any captured kings */
-                c = (bb->kings ^ bb->white ^ a) & bestmove;
-            }
-            else
-            {
-                /* remove any captured kings and do promotion */
-                c = (bb->kings & bestmove) | (a & ROW1);
-            }
-        }
-        else
-        {
-            /* remove any captured pieces */
-            a = bb->white & bestmove;
-            /* update moving piece */
-            b = bestmove - a;
+    return FALSE;
+}
 
-            if ((bb->black & bb->kings & ~bestmove) != 0)
-            {
-                /* the moving piece is a king */
-                /* update moving king and remove any captured kings */
-                c = (bb->kings ^ bb->black ^ b) & bestmove;
-            }
-            else
-            {
-                /* remove any captured kings and do promotion */
-                c = (bb->kings & bestmove) | (b & ROW10);
-            }
-        }
-        /* scramble constructed board position into a hash */
-        a += hash_init;
-        b += hash_init;
-        c += 0x9e3779b97f4a7c13ULL; /* "golden ratio", arbitrary value */
-        mix64(a, b, c);
+/* prefetch the tt cache lines of the positions after a range of moves */
+/* for positions that are likely to be probed soon; all lines are */
+/* requested before any is probed, so that the memory reads overlap */
+/* instead of stalling one after the other */
+/* bb -> current board */
+/* listptr -> compact move list */
+/* first = index of first move */
+/* n = nr. of moves */
+void prefetch_tt_moves(bitboard *bb, cmovelist *listptr, int first, int n)
+{
+    bitboard child;
+    int m;
 
-        /* prefetch best move's board position tt entry cache line */
-        __builtin_prefetch(&trans_tbl[c & tt_mask], 0); /* for reading */
+    for (m = first; m < first + n; m++)
+    {
+        make_move(bb, &listptr->move[m], &child);
+        __builtin_prefetch(&trans_tbl[tt_key(&child) & tt_mask],
+                           0); /* for reading */
     }
-#endif
-    return FALSE;
 }
 
 /* store current board position in transposition table */
@@ -239,76 +722,75 @@ bool probe_tt(bitboard *bb, int ply, int depth, s32 alpha, s32 beta, s32 *scorep
 /* alpha = alpha value */
 /* beta = beta value */
 /* score = value of position */
-/* bestmove -> collapsed best move found by search */
-void store_tt(bitboard *bb, int ply, int depth, s32 alpha, s32 beta, s32 score, u64 bestmove)
+/* bestmove = best move found by search, as from/to pair with */
+/*            capture hash */
+void store_tt(bitboard *bb, int ply, int depth, s32 alpha, s32 beta, s32 score, int bestmove)
 {
-    ttentry *ttslot;
+    ttbucket *bucket;
     u32 ttsig;
-    u64 oldbest;
-    u64 a, b, c;
+    u64 key, word, oldword;
+    int i, m, value, minvalue, capt, oldcapt;
 
-    /* scramble board position into a hash */
-    a = bb->white + hash_init;
-    b = bb->black + hash_init;
-    c = bb->kings + 0x9e3779b97f4a7c13ULL; /* "golden ratio", arbitrary value */
-    mix64(a, b, c);
+    key = tt_key(bb);
+    bucket = &trans_tbl[key & tt_mask];
+    ttsig = (u32)(key >> 44);
 
-    ttslot = &trans_tbl[c & tt_mask];
-    ttsig = ((u32)b ^ bb->side);
-
-    /* check signature to see if current position is stored in slot 0 */
-    if (ttslot[0].ttsig == ttsig)
+    /* if the current position is stored already, update that slot */
+    /* in case there is no old one */
+    oldword = (u64)(bestmove & TTMOVEMASK) << TTMOVESHIFT;
+    oldcapt = bestmove >> TTCAPTSHIFT;
+    for (i = 0; i < TTSLOTS; i++)
     {
-        oldbest = ttslot[0].bestmove; /* set aside old best move from tt */
+        if (read_slot(bucket, i, ttsig, &oldword, &oldcapt))
+        {
+            break; /* out of for loop */
+        }
     }
-    /* if not found in slot 0, try slot 1 */
-    else if (ttslot[1].ttsig == ttsig)
+    if (i == TTSLOTS)
     {
-        oldbest = ttslot[1].bestmove; /* set aside old best move from tt */
-        ttslot[1] = ttslot[0];        /* move slots to make room */
+        /* otherwise replace the least valuable slot */
+        i = 0;
+        minvalue = slot_value(bucket->word[0]);
+        for (m = 1; m < TTSLOTS; m++)
+        {
+            value = slot_value(bucket->word[m]);
+            if (value < minvalue)
+            {
+                minvalue = value;
+                i = m;
+            }
+        }
     }
-    /* if not found in slot 1, try slot 2 */
-    else if (ttslot[2].ttsig == ttsig)
+
+    /* if alpha bound, prefer old slot's best move, since */
+    /* the alpha fail-low's best move is near worthless */
+    if (score <= alpha)
     {
-        /* found, set aside old best move from tt */
-        oldbest = ttslot[2].bestmove;
-        ttslot[2] = ttslot[1];        /* move slots to make room */
-        ttslot[1] = ttslot[0];
+        word = (oldword & ((u64)TTMOVEMASK << TTMOVESHIFT)) | TTALPHA;
+        capt = oldcapt;
     }
-    /* if not found in slot 2, try slot 3 */
-    else if (ttslot[3].ttsig == ttsig)
+    else
     {
-        /* found, set aside old best move from tt */
-        oldbest = ttslot[3].bestmove;
-        ttslot[3] = ttslot[2];        /* move slots to make room */
-        ttslot[2] = ttslot[1];
-        ttslot[1] = ttslot[0];
+        word = (u64)(bestmove & TTMOVEMASK) << TTMOVESHIFT;
+        capt = bestmove >> TTCAPTSHIFT;
     }
-    else
+    if (score >= beta)
     {
-        oldbest = bestmove;           /* there is no old best move */
-        ttslot[3] = ttslot[2];        /* move slots to make room */
-        ttslot[2] = ttslot[1];
-        ttslot[1] = ttslot[0];
-    }
-    /* store new data in slot 0 */
-    ttslot[0].ttsig = ttsig;
-    ttslot[0].depth = depth;
-    ttslot[0].score = score;
-    ttslot[0].alphabound = (score <= alpha);
-    ttslot[0].betabound = (score >= beta);
-    /* if alpha bound, prefer old slot's best move, since */
-    /* the alpha fail-low's best move is near worthless */
-    ttslot[0].bestmove = (score <= alpha) ? oldbest : bestmove;
+        word |= TTBETA;
+    }
+    word |= ((u64)depth & TTDEPTH) << TTDEPTHSHIFT;
     /* adjust dtw score for root node level */
     if (score > INFIN - MAXEXACT)
     {
-        ttslot[0].score += ply;
+        score += ply;
     }
     else if (score < MAXEXACT - INFIN)
     {
-        ttslot[0].score -= ply;
+        score -= ply;
     }
+    word |= (u32)score;
+    /* store new data in the chosen slot */
+    write_slot(bucket, i, ttsig, word, capt);
 }
 
 /* recursive part of finding the PV continuation moves in */
@@ -319,9 +801,9 @@ void store_tt(bitboard *bb, int ply, int depth, s32 alpha, s32 beta, s32 score,
 static void print_pvmoves(bitboard *bb, int ply)
 {
     movelist list;
-    u64 bestmove;
     s32 score;
-    int m;
+    u64 opp, capt;
+    int m, bestmove, mtt = -1;
 
     /* find next move, alpha- or beta-bound score is fine, too */
     /* (20 is an arbitrary limit, also preventing cycles */
@@ -329,14 +811,31 @@ static void print_pvmoves(bitboard *bb, int ply)
     {
         /* generate all valid moves */
         gen_moves(bb, &list, NULL, TRUE);
+        opp = (bb->side == W) ? bb->black : bb->white;
         for (m = 0; m < list.count; m++)
         {
-            if ((list.move[m].white | list.move[m].black) == bestmove)
+            if (move_square(&list.move[m], FROMTO) != (bestmove & TTMOVEMASK))
+            {
+                continue;
+            }
+            /* prefer the capture whose captured pieces match the hash */
+            capt = opp & ~((bb->side == W) ? list.move[m].black :
+                                             list.move[m].white);
+            if (tt_capthash(capt) == bestmove >> TTCAPTSHIFT)
             {
-                print_move(&list.move[m]);
-                print_pvmoves(&list.move[m], ply + 1); /* recurse */
-                return;
+                mtt = m;
+                break; /* out of for loop */
             }
+            if (mtt < 0)
+            {
+                mtt = m;
+            }
+        }
+        if (mtt >= 0)
+        {
+            print_move(&list.move[mtt]);
+            print_pvmoves(&list.move[mtt], ply + 1); /* recurse */
+            return;
         }
     }
     /* no bestmove found in transposition table or among valid moves */
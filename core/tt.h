@@ -17,35 +17,81 @@
     along with Moby Dam.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-/* mix64 -- Source: lookup8.c, by Bob Jenkins, January 4 1997, Public Domain. */
-#define mix64(a,b,c) \
-{ \
-  a -= b; a -= c; a ^= (c>>43); \
-  b -= c; b -= a; b ^= (a<<9); \
-  c -= a; c -= b; c ^= (b>>8); \
-  a -= b; a -= c; a ^= (c>>38); \
-  b -= c; b -= a; b ^= (a<<23); \
-  c -= a; c -= b; c ^= (b>>5); \
-  a -= b; a -= c; a ^= (c>>35); \
-  b -= c; b -= a; b ^= (a<<49); \
-  c -= a; c -= b; c ^= (b>>11); \
-  a -= b; a -= c; a ^= (c>>12); \
-  b -= c; b -= a; b ^= (a<<18); \
-  c -= a; c -= b; c ^= (b>>22); \
-}
+/* zobrist key for the side to move, xor-ed into the tt key when B moves */
+#define ZOBSIDE 0x5bd1e9955bd1e995ULL
+
+/* a tt bucket fills one cache line and holds 6 entries; */
+/* each entry is written and read as a 64-bit word with all of its */
+/* data, and a 16-bit check, which holds the 16 msb's of the signature */
+/* xor-ed with the scrambled word, so that an entry torn by concurrent */
+/* stores from multiple search threads fails the signature check */
+#define TTSLOTS 6
+
+#define MAXWIPERS 64  /* max nr. of threads wiping the table */
 
 typedef struct {
-    u32 ttsig;
-    s32 score;
-    u64 depth      :  8;
-    u64 alphabound :  1;
-    u64 betabound  :  1;
-    u64 bestmove   : 54;
-} ttentry;
+    u64 word[TTSLOTS];  /* score, depth, bounds, generation, move, sig lsb's */
+    u16 check[TTSLOTS]; /* signature msb's, xor-ed with scrambled word */
+                        /* and capture hash */
+    u32 capt;           /* capture hash of each slot's best move, 5 bits */
+} ttbucket;
+
+/* layout of the word */
+#define TTSCORE     0xffffffffULL /* 32 bits score */
+#define TTDEPTHSHIFT 32         /* 8 bits search depth */
+#define TTDEPTH     0xff
+#define TTALPHA     (1ULL << 40) /* alpha bound flag */
+#define TTBETA      (1ULL << 41) /* beta bound flag */
+#define TTGENSHIFT  42          /* 6 bits generation */
+#define TTGENMASK   0x3f
+#define TTSTALE     32          /* age at which an entry is cleared */
+#define TTSLICES    32          /* cleared per generation, see clear_stale */
+                                /* (TTSTALE + TTSLICES - 1 <= TTGENMASK) */
+#define TTMOVESHIFT 48          /* 12 bits best move as from/to pair */
+#define TTMOVEMASK  0xfff
+#define TTSIGSHIFT  60          /* 4 lsb's of the 20-bit signature */
+
+/* captures with the same from/to pair (e.g. king captures along */
+/* different paths) are told apart by a hash of the captured pieces, */
+/* kept in the bucket's capt field; the tt functions take and give the */
+/* best move as from/to pair | capture hash << TTCAPTSHIFT, which is */
+/* just the from/to pair for non-captures; if no move has a matching */
+/* hash, the first one with the from/to pair is taken */
+#define TTCAPTSHIFT 12
+#define TTCAPTBITS  5
+#define TTCAPTMASK  0x1f
+#define tt_capthash(c) \
+    ((int)(((c)*0x9e3779b97f4a7c15ULL) >> (64 - TTCAPTBITS)))
+
+/* scramble word, so that any change in it affects the check bits */
+#define tt_scramble(w) ((u16)(((w)*0x9e3779b97f4a7c15ULL) >> 48))
+
+/* a saved or memory-mapped tt file starts with this header, */
+/* followed by the buckets; increase TTVERSION whenever the entry */
+/* layout or the tt key computation changes, to reject stale files */
+#define TTMAGIC   "MobyTT\x1a"
+#define TTVERSION 2
+
+typedef struct {
+    char magic[8];      /* TTMAGIC */
+    u32 version;        /* TTVERSION */
+    u32 slots;          /* nr. of entries per bucket */
+    u64 buckets;        /* nr. of buckets */
+    u64 hash_init;      /* hash function initializer of the entries */
+    u32 generation;     /* generation counter, the 6 lsb's are used */
+    u8 unused[28];      /* (header fills a cache line) */
+} ttheader;
+
+extern u32 tt_generation;
 
 extern void flush_tt(void);
+extern void age_tt(void);
+extern int hashfull_tt(void);
 extern void wipe_tt(void);
-extern bool init_tt(u32 exp);
-extern bool probe_tt(bitboard *bb, int ply, int depth, s32 alpha, s32 beta, s32 *scoreptr, u64 *bestptr);
-extern void store_tt(bitboard *bb, int ply, int depth, s32 alpha, s32 beta, s32 score, u64 bestmove);
+extern bool init_tt(u32 exp, int nthreads, bool interleave, char *name, bool shared);
+extern bool save_tt(char *filename);
+extern bool load_tt(char *filename);
+extern bool probe_tt(bitboard *bb, int ply, int depth, s32 alpha, s32 beta, s32 *scoreptr, int *bestptr);
+extern void store_tt(bitboard *bb, int ply, int depth, s32 alpha, s32 beta, s32 score, int bestmove);
+extern void prefetch_tt_moves(bitboard *bb, cmovelist *listptr, int first, int n);
 extern void print_pv(bitboard *ply0mvptr);
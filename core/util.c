@@ -29,8 +29,6 @@
 #define PATHDELIM '/'            /* path delimiter */
 #endif
 
-char db_path[PATH_MAX];          /* constructed path of database file */
-
 /* bit positions 10, 21, 32, 43 are "ghost squares", enabling */
 /* efficient move generation: diagonally adjacent squares */
 /* are always shifts of -6/-5/+5/+6, independent of rank */
@@ -61,6 +59,43 @@ S36, S37, S38, S39, S40,
 S46, S47, S48, S49, S50
 };
 
+/* zobrist keys are derived from their index with the splitmix64 */
+/* finalizer, as constant expressions, so no initialization is needed */
+#define ZMIX1(x) (((x) ^ ((x) >> 30))*0xbf58476d1ce4e5b9ULL)
+#define ZMIX2(x) (((x) ^ ((x) >> 27))*0x94d049bb133111ebULL)
+#define ZMIX3(x) ((x) ^ ((x) >> 31))
+#define ZOB(n)   ZMIX3(ZMIX2(ZMIX1(((u64)(n) + 1)*0x9e3779b97f4a7c15ULL)))
+#define ZOB8(n)  ZOB(n), ZOB(n + 1), ZOB(n + 2), ZOB(n + 3), \
+                 ZOB(n + 4), ZOB(n + 5), ZOB(n + 6), ZOB(n + 7)
+#define ZOB64(n) { ZOB8(n), ZOB8(n + 8), ZOB8(n + 16), ZOB8(n + 24), \
+                   ZOB8(n + 32), ZOB8(n + 40), ZOB8(n + 48), ZOB8(n + 56) }
+
+const u64 zobrist[4][64] = { /* per piece type MW, KW, MB, KB and bitpos */
+    ZOB64(0), ZOB64(64), ZOB64(128), ZOB64(192)
+};
+
+/* compute the zobrist hash of the pieces on the board from scratch */
+/* make_move and place_piece keep it up to date incrementally */
+/* in/out: bb -> board */
+void hash_board(bitboard *bb)
+{
+    u64 pcbits, pcbit;
+    int pc;
+
+    bb->hash = 0;
+    for (pc = MW; pc <= KB; pc++)
+    {
+        pcbits = (pc <= KW) ? bb->white : bb->black;
+        pcbits &= (pc == MW || pc == MB) ? ~bb->kings : bb->kings;
+        while (pcbits != 0)
+        {
+            pcbit = pcbits & -pcbits;
+            pcbits -= pcbit;
+            bb->hash ^= zobrist[pc][__builtin_ctzll(pcbit)];
+        }
+    }
+}
+
 /* convert square number to bitfield */
 /* square = square number 1..50 */
 /* returns: bitfield with corresponding bit set */
@@ -87,6 +122,7 @@ void init_board(bitboard *bb)
     bb->side  = W;
     bb->moveinfo = 1; /* draw backstop */
     bb->parent = NULL;
+    hash_board(bb);
 }
 
 /* set up an empty board */
@@ -99,6 +135,7 @@ void empty_board(bitboard *bb)
     bb->side  = W;
     bb->moveinfo = 1; /* draw backstop */
     bb->parent = NULL;
+    bb->hash = 0;
 }
 
 /* place a piece on the board */
@@ -139,6 +176,7 @@ bool place_piece(bitboard *bb, int sq, int pc)
     default:
         return FALSE; /* not a valid piece */
     }
+    bb->hash ^= zobrist[pc][__builtin_ctzll(pcbit)];
     return TRUE;
 }
 
@@ -357,6 +395,26 @@ int move_square(bitboard *mvptr, int fromto)
     }
 }
 
+/* find square number(s) of a compact move */
+/* mvptr -> compact move structure */
+/* fromto = FROM, TO or FROMTO */
+/* returns: as move_square for the board resulting from the move */
+int cmove_square(cmove *mvptr, int fromto)
+{
+    if (fromto == FROM)
+    {
+        return bitpos2square[mvptr->from];
+    }
+    else if (fromto == TO)
+    {
+        return bitpos2square[mvptr->to];
+    }
+    else /* FROMTO, also when from=to */
+    {
+        return 51*bitpos2square[mvptr->from] + bitpos2square[mvptr->to];
+    }
+}
+
 /* print move to string */
 /* str -> destination string, must be at least 7 chars */
 /* mvptr -> move structure */
@@ -665,6 +723,7 @@ void invert_board(bitboard *bb)
     bb->black = __builtin_bswap64(white) >> 10;
     bb->kings = __builtin_bswap64(kings) >> 10;
     bb->side = W + B - bb->side;
+    hash_board(bb);
 }
 
 /* give current timestamp in milliseconds */
@@ -688,12 +747,106 @@ u32 get_tick(void)
 #endif
 }
 
+/* find which variant of the hot kernels runs on this cpu; */
+/* this makes the same choice as the ifunc resolvers, see HOTPATH */
+/* returns: name of the variant */
+char *cpu_variant(void)
+{
+#ifdef HOTCLONES
+    if (__builtin_cpu_supports("x86-64-v3"))
+    {
+        return "x86-64-v3 (avx2, bmi2, popcnt)";
+    }
+    if (__builtin_cpu_supports("popcnt"))
+    {
+        return "popcnt";
+    }
+    return "generic";
+#else
+    return "as compiled";
+#endif
+}
+
+#ifdef _WIN32
+typedef struct {               /* thread start info for Windows */
+    void *(*func)(void *);
+    void *arg;
+} thrdstart;
+
+/* Windows thread entry point, calling the portable thread function */
+/* param -> thread start info, freed here */
+/* returns: thread exit code */
+static DWORD WINAPI thread_entry(LPVOID param)
+{
+    thrdstart ts;
+
+    ts = *(thrdstart *) param;
+    free(param);
+    ts.func(ts.arg);
+    return 0;
+}
+#endif
+
+/* start a new thread */
+/* out: thp -> handle of the new thread */
+/* func -> function to run in the new thread */
+/* arg -> argument to pass to the function */
+/* returns: TRUE if successful */
+bool start_thread(thrd *thp, void *(*func)(void *), void *arg)
+{
+#ifdef _WIN32
+    thrdstart *tsp;
+
+    tsp = malloc(sizeof(thrdstart));
+    if (tsp == NULL)
+    {
+        return FALSE;
+    }
+    tsp->func = func;
+    tsp->arg = arg;
+    *thp = CreateThread(NULL, 0, thread_entry, tsp, 0, NULL);
+    if (*thp == NULL)
+    {
+        free(tsp);
+        return FALSE;
+    }
+    return TRUE;
+#else
+    return pthread_create(thp, NULL, func, arg) == 0;
+#endif
+}
+
+/* wait for a thread to terminate */
+/* th = handle of the thread */
+void join_thread(thrd th)
+{
+#ifdef _WIN32
+    WaitForSingleObject(th, INFINITE);
+    CloseHandle(th);
+#else
+    pthread_join(th, NULL);
+#endif
+}
+
+/* let a thread run on its own, its resources are released when it */
+/* terminates; the handle can't be used anymore */
+/* th = handle of the thread */
+void detach_thread(thrd th)
+{
+#ifdef _WIN32
+    CloseHandle(th);
+#else
+    pthread_detach(th);
+#endif
+}
+
 /* get database directory */
 /* dirs = directory path to search */
 /* section = which part of (semi)colon-separated path to select */
-/* returns: TRUE = requested part copied to db_path */
-/*          FALSE = requested part not found        */
-static bool get_dbdir(char *dirs, int section)
+/* out: path = the directory, with a final delimiter */
+/* returns: TRUE = requested part copied to path */
+/*          FALSE = requested part not found     */
+static bool get_dbdir(char *dirs, int section, char *path)
 {
     char *dbptr, *sepptr;
     size_t len;
@@ -718,20 +871,22 @@ static bool get_dbdir(char *dirs, int section)
     {
         len = strlen(dbptr);
     }
-    strncpy(db_path, dbptr, len);
-    if (db_path[len - 1] != PATHDELIM)
+    strncpy(path, dbptr, len);
+    if (path[len - 1] != PATHDELIM)
     {
-        db_path[len++] = PATHDELIM; /* final slash */
+        path[len++] = PATHDELIM; /* final slash */
     }
-    db_path[len] = '\0';
+    path[len] = '\0';
     return TRUE;
 }
 
 /* locate database file */
 /* dirs = directory/ies to search */
 /* name = basename of desired file */
-/* returns: the path, or NULL if not found */
-char *locate_dbfile(char *dirs, char *name)
+/* out: path = buffer of PATH_MAX chars for the full path; callers */
+/*             each have their own, so threads can look up files */
+/* returns: path, or NULL if not found */
+char *locate_dbfile(char *dirs, char *name, char *path)
 {
     struct stat statbuf;
     int  section;
@@ -739,13 +894,13 @@ char *locate_dbfile(char *dirs, char *name)
 
     section = 0;
     do {
-        if (!get_dbdir(dirs, section)) /* try next dir in db path */
+        if (!get_dbdir(dirs, section, path)) /* try next dir in db path */
         {
             return NULL;
         }
-        strcat(db_path, name);         /* construct the path */
-        ret = stat(db_path, &statbuf);
+        strcat(path, name);            /* construct the path */
+        ret = stat(path, &statbuf);
         section++;
     } while (ret == -1);
-    return db_path;
+    return path;
 }
@@ -17,6 +17,9 @@
     along with Moby Dam.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+extern const u64 zobrist[4][64];
+
+extern void hash_board(bitboard *bb);
 extern u64 conv_to_bit(int square);
 extern int conv_to_square(u64 pcbit);
 extern void init_board(bitboard *bb);
@@ -25,6 +28,7 @@ extern bool place_piece(bitboard *bb, int sq, int pc);
 extern bool setup_fen(bitboard *bb, char *fen);
 extern u64 move_captbits(bitboard *mvptr);
 extern int move_square(bitboard *mvptr, int fromto);
+extern int cmove_square(cmove *mvptr, int fromto);
 extern int sprint_move(char *str, bitboard *mvptr);
 extern void print_move(bitboard *mvptr);
 extern int sprint_move_long(char *str, movelist *listptr, int m);
@@ -34,4 +38,8 @@ extern bool is_draw(bitboard *startbb, int ply, char *descr);
 extern int bb_compare(bitboard *bb1, bitboard *bb2);
 extern void invert_board(bitboard *bb);
 extern u32 get_tick(void);
-extern char *locate_dbfile(char *dirs, char *name);
+extern char *cpu_variant(void);
+extern bool start_thread(thrd *thp, void *(*func)(void *), void *arg);
+extern void join_thread(thrd th);
+extern void detach_thread(thrd th);
+extern char *locate_dbfile(char *dirs, char *name, char *path);
@@ -41,6 +41,14 @@ u32 move_time;              /* nominal think time for engine */
 int test_depth;             /* max iterative search depth */
 u32 test_time;              /* max search time per move (ms) */
 
+srchctx engine_search;      /* search context of the engine */
+int num_threads = 1;        /* nr. of search threads */
+bool numa_interleave;       /* spread tt memory over numa nodes */
+u32 cache_mib = 16;         /* egdb block cache per search thread (MiB) */
+bool unpack_dtw;            /* keep 2-4 piece egdb decompressed in memory */
+u32 bits_mib;               /* budget for 5-6 piece wdl bitbases (MiB) */
+char preload_pcs[8];        /* egdb piece counts to lock, "0" = preload only */
+
 int our_side;               /* engine's side in the game */
 bool game_inprog;           /* game in progress */
 int side_moving;            /* side to move in current root position */
@@ -64,6 +72,8 @@ u32 log_reqtick;            /* time of latest gamereq */
 FILE *fp_msg;               /* message log file ptr */
 char book_file[PATH_MAX] = "book.opn"; /* opening book filename */
 char db_dirs[PATH_MAX] = "."; /* directory/ies of database files */
+char tt_file[PATH_MAX];     /* memory-mapped tt filename, or empty */
+bool tt_shared;             /* tt_file is a shared memory segment name */
 char msg_file[PATH_MAX] = "dxp.log"; /* message log filename */
 char out_file[PATH_MAX] = "engine.log"; /* engine log filename */
 char pdn_format[PATH_MAX] = "result%d.pdn"; /* pdn log filename format */
@@ -76,6 +86,7 @@ bool debug_info;            /* print extra debug info */
 bool verbose_info;          /* print extra verbose info */
 bool do_pondering;          /* search while awaiting opponent move */
 bool ponder_state;          /* pondering state for current game */
+bool searching;             /* engine is thinking or pondering */
 
 /* convert ascii number to integer */
 /* ptr -> number in input string */
@@ -128,6 +139,15 @@ static void set_movetime(void)
     move_time = period/(moves + 2);   /* allow for some search time extension */
 }
 
+/* pass the current engine settings to the search context */
+static void prep_search(void)
+{
+    engine_search.verbose = verbose_info;
+    engine_search.move_time = move_time;
+    engine_search.test_time = test_time;
+    engine_search.test_depth = test_depth;
+}
+
 /* log DamExchange message */
 /* buf -> the buffer, nul-terminated */
 /* dir -> string indicating direction */
@@ -330,6 +350,24 @@ static void rcv_console(char *buf, int len)
         printf("time limit = %u ms\n", test_time);
         fprintf(stderr, "time limit = %u ms\n", test_time);
     }
+    if (strncasecmp(buf, "ttsave ", 7) == EQUAL) /* save tt to a file */
+    {
+        fprintf(stderr, "ttsave %s\n",
+                save_tt(&buf[7]) ? "done" : "failed");
+    }
+    if (strncasecmp(buf, "ttload ", 7) == EQUAL) /* load tt from a file */
+    {
+        /* the search threads must not store while the table changes */
+        if (searching)
+        {
+            fprintf(stderr, "ttload refused while searching\n");
+        }
+        else
+        {
+            fprintf(stderr, "ttload %s\n",
+                    load_tt(&buf[7]) ? "done" : "failed");
+        }
+    }
     if (strcasecmp(buf, "checkend") == EQUAL) /* check endgame files */
     {
         fprintf(stderr, "checking...\n");
@@ -363,6 +401,8 @@ static void rcv_console(char *buf, int len)
         fprintf(stderr, "delay        short delay before first move (toggle)\n");
         fprintf(stderr, "depth <n>    set iterative search depth limit (0=no limit)\n");
         fprintf(stderr, "time <n>     set hard time limit per move (in ms) (0=no limit)\n");
+        fprintf(stderr, "ttsave <f>   save transposition table to file f\n");
+        fprintf(stderr, "ttload <f>   load transposition table from file f (when idle)\n");
         fprintf(stderr, "checkend     check endgame database files\n");
 #ifdef _DEBUG
         fprintf(stderr, "debug        log lots of extra debug info (toggle)\n");
@@ -970,6 +1010,14 @@ static void main_loop(void)
     srand(get_tick());
     init_book(book_file);
     init_enddb(db_dirs);
+    if (unpack_dtw)
+    {
+        unpack_enddb();
+    }
+    if (preload_pcs[0] != '\0' && !preload_enddb(preload_pcs))
+    {
+        printf("can't start egdb preload thread\n");
+    }
     init_break(db_dirs);
 
     empty_board(&brd);
@@ -1140,7 +1188,11 @@ static void main_loop(void)
                 {
                     flush_tt();
                 }
-                clear_hist();
+                clear_hist(&engine_search);
+                if (bits_mib != 0)
+                {
+                    select_wdlbits((u64) bits_mib << 20);
+                }
 
                 send_gameacc(0);
 
@@ -1222,7 +1274,10 @@ static void main_loop(void)
             {
                 if (ponder_state)
                 {
-                    ponder_state = engine_ponder(bb, 100);
+                    prep_search();
+                    searching = TRUE;
+                    ponder_state = engine_ponder(&engine_search, bb, 100);
+                    searching = FALSE;
                 }
                 else
                 {
@@ -1343,7 +1398,10 @@ static void main_loop(void)
 
             /* let engine determine the next move to be made */
             set_movetime();
-            engine_think(&list, 100);
+            prep_search();
+            searching = TRUE;
+            engine_think(&engine_search, &list, 100);
+            searching = FALSE;
             if (opt_fen[0] != '\0')
             {
                 /* terminate optimization profiling run */
@@ -1424,7 +1482,7 @@ int main(int argc, char *argv[])
 
     while (TRUE)
     {
-        opt = getopt(argc, argv, "b:e:t:zc:p:f:m:l:o:");
+        opt = getopt(argc, argv, "b:e:t:T:S:j:w:W:xP:nzc:p:f:m:l:o:");
         if (opt == -1)
         {
             break; /* done */
@@ -1439,12 +1497,53 @@ int main(int argc, char *argv[])
             break;
         case 't':
             exp = atoi(optarg);
-            if (exp < 20 || exp > 30)
+            if (exp < 20 || exp > 36)
             {
                 printf("exp out of range, using default (25)\n");
                 exp = 25;
             }
             break;
+        case 'T':
+            strncpy(tt_file, optarg, sizeof tt_file - 1);
+            tt_shared = FALSE;
+            break;
+        case 'S':
+            strncpy(tt_file, optarg, sizeof tt_file - 1);
+            tt_shared = TRUE;
+            break;
+        case 'j':
+            num_threads = atoi(optarg);
+            if (num_threads < 1 || num_threads > MAXTHREADS)
+            {
+                printf("thread count out of range, using default (1)\n");
+                num_threads = 1;
+            }
+            break;
+        case 'w':
+            cache_mib = atoi(optarg);
+            if (cache_mib > 4096)
+            {
+                printf("cache size out of range, using default (16)\n");
+                cache_mib = 16;
+            }
+            break;
+        case 'W':
+            bits_mib = atoi(optarg);
+            if (bits_mib > 65536)
+            {
+                printf("bitbase budget out of range, using default (0)\n");
+                bits_mib = 0;
+            }
+            break;
+        case 'x':
+            unpack_dtw = TRUE;
+            break;
+        case 'P':
+            strncpy(preload_pcs, optarg, sizeof preload_pcs - 1);
+            break;
+        case 'n':
+            numa_interleave = TRUE;
+            break;
         case 'z':
             do_pondering = TRUE;
             break;
@@ -1467,10 +1566,10 @@ int main(int argc, char *argv[])
             strncpy(opt_fen, optarg, sizeof opt_fen - 1);
             break;
         default:
-            printf("Usage: %s [-b bookfile] [-e dbdir] [-t exp] [-z] "
-                   "[-c host ] [-p port] "
-                   "[-f format] [-m msgfile] [-l logfile] "
-                   "[-o FEN]\n", argv[0]);
+            printf("Usage: %s [-b bookfile] [-e dbdir] [-t exp] [-T ttfile] "
+                   "[-S ttshm] [-j threads] [-w mib] [-W mib] [-x] "
+                   "[-P pcs] [-n] [-z] [-c host ] [-p port] [-f format] "
+                   "[-m msgfile] [-l logfile] [-o FEN]\n", argv[0]);
             printf("Engine settings:\n"
                    "  -b bookfile = file name of opening book\n"
                    "       (default: book.opn)\n"
@@ -1481,9 +1580,32 @@ int main(int argc, char *argv[])
 #endif
                                              "colon-separated directories)\n"
                    "       (default: current directory)\n"
-                   "  -t exp = exponent of transposition table size, 20..30\n"
-                   "       (default: 25 = 2^25 entries = 512MiB)\n"
-                   "  -z = do pondering (search while awaiting opponent move)\n");
+                   "  -t exp = exponent of transposition table size, 20..36\n"
+                   "       (default: 25 = 2^25*16 bytes = 512MiB)\n"
+                   "  -T ttfile = memory-map transposition table to file,\n"
+                   "       keeping its entries for the next run\n"
+                   "       (default: not in a file)\n"
+                   "  -S ttshm = share transposition table with other\n"
+                   "       processes in named shared memory (e.g. /mobydam),\n"
+                   "       all using the same -t exp\n"
+                   "       (default: not shared)\n"
+                   "  -j threads = number of search threads, 1..%d\n"
+                   "       (default: 1)\n"
+                   "  -w mib = egdb block cache per search thread in MiB,\n"
+                   "       0..4096, 0 = no cache (default: 16, which adds\n"
+                   "       16MiB of memory use per search thread)\n"
+                   "  -W mib = memory for 5-6 piece egdb bitbases in MiB,\n"
+                   "       filled at each game start with the classes\n"
+                   "       probed most so far, 0..65536 (default: 0)\n"
+                   "  -x = decompress the 2-4 piece egdb into memory\n"
+                   "       (about 150MiB, default: read from the files)\n"
+                   "  -P pcs = read all egdb files into memory in the\n"
+                   "       background at startup, and lock the files of\n"
+                   "       these piece counts, e.g. 56, or 0 for none\n"
+                   "       (default: read the files as needed)\n"
+                   "  -n = interleave transposition table over numa nodes\n"
+                   "  -z = do pondering (search while awaiting opponent move)\n",
+                   MAXTHREADS);
             printf("DamExchange options:\n"
                    "  -c host = connect to host (dns name or ip address)\n"
                    "       (default: listen instead of connect)\n"
@@ -1541,8 +1663,20 @@ int main(int argc, char *argv[])
         }
         printf("%s%s\n%s\n", ctime(&now), engine_name,
                "compiled with " TOSTRING(CFLAGS));
+        printf("hot kernels use %s variant\n", cpu_variant());
+        printf("search threads=%d\n", num_threads);
+        printf("move generator uses %s path\n", init_movegen());
+
+        printf("egdb block cache=%uMiB per thread\n", cache_mib);
+        if (!init_search(&engine_search, num_threads, cache_mib*1024,
+                         &main_event, poll_event))
+        {
+            fprintf(stderr, "search memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
 
-        if (!init_tt(exp))
+        if (!init_tt(exp, num_threads, numa_interleave,
+                     (tt_file[0] != '\0') ? tt_file : NULL, tt_shared))
         {
             fprintf(stderr, "tt memory allocation failed\n");
             exit(EXIT_FAILURE);
@@ -26,43 +26,55 @@ typedef struct {               /* set of board positions */
     bitboard pos[128];
 } poslist;
 
-typedef struct {               /* killer store per ply */
-    int k1;
-    int k2;
-} kilst;
-
-kilst killer_list[MAXPLY + 1]; /* killer store for all plies */
-u32 good_hist[51*51];          /* history of good moves */
-
-s32 iter0_score;               /* static root value before iterations start */
-int max_ply;                   /* maximum ply to search */
-int db_maxpc;                  /* maximum piece count for wdl lookup */
-s32 db_threshold;              /* egdb win/loss score cutoff threshold */
-int m_explored;                /* index of move being searched at ply 0 */
-
-u32 start_tick;                /* time tick at start of search */
-u32 last_tick;                 /* most recent time tick */
-u32 think_time;                /* time budget in milliseconds */
-
-/* statistics */
-u64 node_count;                /* nr. of nodes visited */
-u64 nonleaf_count;             /* nr. of non-leaf nodes visited */
-u64 ttprobe_count;             /* nr. of tt probes */
-u64 tthit_count;               /* nr. of tt hits */
-u64 ttbest_count;              /* nr. of tt bestmoves */
-u64 etctst_count;              /* nr. of etc tests */
-u64 etchit_count;              /* nr. of etc hits */
-u64 etccut_count;              /* nr. of etc cutoffs */
-
-/* clear history array */
-void clear_hist(void)
+/* initialize a search context */
+/* ctx -> search context */
+/* nthreads = nr. of search threads, including the main thread */
+/* cache_kib = size of the egdb block cache per thread in KiB, or 0 */
+/* event -> events that terminate the search */
+/* poll -> function that checks for new events, or NULL */
+/* returns: TRUE if successful */
+bool init_search(srchctx *ctx, int nthreads, u32 cache_kib, mev *event,
+                 void (*poll)(int wait))
 {
-    memset(good_hist, 0, sizeof good_hist);
+    int t;
+
+    memset(ctx, 0, sizeof *ctx);
+    ctx->threads = calloc(nthreads, sizeof *ctx->threads);
+    if (ctx->threads == NULL)
+    {
+        return FALSE;
+    }
+    for (t = 0; t < nthreads; t++)
+    {
+        ctx->threads[t].ctx = ctx;
+        ctx->threads[t].id = t;
+        if (!init_wdlcache(&ctx->threads[t].wdlc, cache_kib))
+        {
+            return FALSE;
+        }
+    }
+    ctx->nthreads = nthreads;
+    ctx->event = event;
+    ctx->poll = poll;
+    return TRUE;
+}
+
+/* clear history arrays */
+/* ctx -> search context */
+void clear_hist(srchctx *ctx)
+{
+    int t;
+
+    for (t = 0; t < ctx->nthreads; t++)
+    {
+        memset(ctx->threads[t].good_hist, 0, sizeof ctx->threads[t].good_hist);
+    }
 }
 
 /* fade history array */
 /* let info from past moves gradually fade away */
-static void fade_hist(void)
+/* tp -> search thread data */
+static void fade_hist(srchthrd *tp)
 {
     int i, j;
 
@@ -70,22 +82,65 @@ static void fade_hist(void)
     {
         for (j = 1; j <= 50; j++)
         {
-            good_hist[51*i + j] >>= 3;
+            tp->good_hist[51*i + j] >>= 3;
         }
     }
 }
 
+/* prepare the search data of all threads for a new search */
+/* ctx -> search context */
+static void reset_threads(srchctx *ctx)
+{
+    srchthrd *tp;
+    int t;
+
+    for (t = 0; t < ctx->nthreads; t++)
+    {
+        tp = &ctx->threads[t];
+        tp->depth = 0;
+        fade_hist(tp);
+        memset(tp->killer_list, 0, sizeof tp->killer_list);
+
+        /* clear statistics counts */
+        tp->node_count = tp->nonleaf_count = 0;
+        tp->ttprobe_count = tp->tthit_count = tp->ttbest_count = 0;
+        tp->etctst_count = tp->etchit_count = tp->etccut_count = 0;
+        tp->stage_count = tp->stagecut_count = 0;
+        tp->gencalls = tp->generated = tp->evals = 0;
+        memset(tp->endacc, 0, sizeof tp->endacc);
+        memset(tp->endblk, 0, sizeof tp->endblk);
+    }
+
+    /* the caller is the main search thread */
+    tp = &ctx->threads[0];
+    end_cache = (tp->wdlc.sets != 0) ? &tp->wdlc : NULL;
+}
+
+/* check if the search must be aborted */
+/* the main thread reacts to engine events, */
+/* the helper threads stop when the main thread is done */
+/* tp -> search thread data */
+/* returns: TRUE if search must be aborted */
+__inline__
+static bool search_aborted(srchthrd *tp)
+{
+    return (tp->id == 0) ? tp->ctx->event->any : tp->ctx->abort;
+}
+
 /* sort moves best-first */
 /* currently using info from transposition table, */
 /* killer moves, and history of earlier good moves */
 /* listptr -> move list to be sorted */
 /* d = tree depth (distance from leaves) */
-/* bestmove = the collapsed best move from the tt */
+/* bestmove = the best move from the tt, as from/to pair with */
+/*            capture hash */
 /* kilptr -> the current ply's killer store */
+/* hist -> the thread's history of good moves */
 __inline__
-static void sort_moves(movelist *listptr, int d, u64 bestmove, kilst *kilptr)
+static void sort_moves(cmovelist *listptr, int d, int bestmove, kilst *kilptr,
+                       u32 *hist)
 {
-    bitboard move;
+    cmove move;
     int fromto;
     int m, mtt = -1;
 #ifdef KIL
@@ -98,14 +153,20 @@ static void sort_moves(movelist *listptr, int d, u64 bestmove, kilst *kilptr)
         /* find the indexes of the interesting moves */
         for (m = 0; m < listptr->count; m++)
         {
-            if (bestmove == (listptr->move[m].white | listptr->move[m].black))
+            fromto = cmove_square(&listptr->move[m], FROMTO);
+            if (fromto == (bestmove & TTMOVEMASK))
             {
-                mtt = m;
+                /* of captures with the same from/to pair, prefer */
+                /* the one whose captured pieces match the hash */
+                if (mtt < 0 || tt_capthash(listptr->move[m].capt) ==
+                               bestmove >> TTCAPTSHIFT)
+                {
+                    mtt = m;
+                }
             }
 #ifdef KIL
             else 
             {
-                fromto = move_square(&listptr->move[m], FROMTO);
                 if (fromto == kilptr->k1)
                 {
                     mk1 = m;
@@ -181,8 +242,8 @@ static void sort_moves(movelist *listptr, int d, u64 bestmove, kilst *kilptr)
             /* first make the good_hist scores fast to access */
             for (i = m; i < listptr->count; i++)
             {
-                fromto = move_square(&listptr->move[i], FROMTO);
-                gh[i] = good_hist[fromto];
+                fromto = cmove_square(&listptr->move[i], FROMTO);
+                gh[i] = hist[fromto];
             }
             /* do insertion sort, is fast for small number of moves */
             for (i = m + 1; i < listptr->count; i++)
@@ -203,48 +264,91 @@ static void sort_moves(movelist *listptr, int d, u64 bestmove, kilst *kilptr)
     }
 }
 
+/* put the moves that sort_moves would place first in front of an */
+/* otherwise empty move list, so that they can be searched before the */
+/* other non-capture moves are generated; any cutoff by one of them */
+/* saves generating and sorting the rest */
+/* bb -> current board, on which no capture is possible */
+/* listptr -> move list to hold the staged moves */
+/* bestmove = the best move from the tt, as from/to pair, or 0 */
+/* kilptr -> the current ply's killer store */
+/* returns: nr. of staged moves */
+static int stage_moves(bitboard *bb, cmovelist *listptr, int bestmove,
+                       kilst *kilptr)
+{
+    int n = 0;
+
+    if (bestmove != 0 && noncapt_cmove(bb, bestmove, &listptr->move[n]))
+    {
+        n++;
+    }
+#ifdef KIL
+    /* the same order as sort_moves: tt best move, killer 1, killer 2 */
+    if (kilptr->k1 != 0 && kilptr->k1 != bestmove &&
+        noncapt_cmove(bb, kilptr->k1, &listptr->move[n]))
+    {
+        n++;
+    }
+    if (kilptr->k2 != 0 && kilptr->k2 != bestmove &&
+        noncapt_cmove(bb, kilptr->k2, &listptr->move[n]))
+    {
+        n++;
+    }
+#endif
+    return n;
+}
+
 /* do the recursive principal variation search */
+/* tp -> search thread data */
 /* bb -> current board */
 /* ply = ply level */
 /* depth = depth of tree to build */
 /* alpha = minimum value to consider */
 /* beta = maximum value to consider */
 /* returns: backed-up score of move tree */
-static s32 pv_search(bitboard *bb, int ply, int depth, s32 alpha, s32 beta)
+HOTPATH
+static s32 pv_search(srchthrd *tp, bitboard *bb, int ply, int depth,
+                     s32 alpha, s32 beta)
 {
-    movelist list;
+    srchctx *ctx = tp->ctx;
+    cmovelist list;
+    bitboard child;
     u32 tick;
-    u64 bestmove;
     s32 origalpha, best, merit;
-    int d, m, bestm, pcnt;
-    int fromto;
+    int d, m, bestm, pcnt, nmoves, nstaged;
+    int fromto, bestmove;
 
     debugf("pv_search enter ply=%d depth=%d side=%d\n",
            ply, depth, bb->side);
-    node_count++;
-    if (node_count%1024 == 0) /* don't peek at the clock too often */
+    tp->node_count++;
+    /* don't peek at the clock too often, helper threads never do */
+    if (tp->node_count%1024 == 0 && tp->id == 0)
     {
         tick = get_tick();
-        if (side_moving == our_side) /* not pondering */
+        if (!ctx->pondering)
         {
             /* time check */
-            if (tick - start_tick >= think_time ||
-                (test_time != 0 && tick - start_tick >= test_time))
+            if (tick - ctx->start_tick >= ctx->think_time ||
+                (ctx->test_time != 0 &&
+                 tick - ctx->start_tick >= ctx->test_time))
             {
                 debugf("pv_search time limit reached ply=%d depth=%d\n",
                        ply, depth);
-                main_event.movenow = TRUE;
+                ctx->event->movenow = TRUE;
                 return 0;
             }
         }
         /* event check every 100ms or so */
-        if (tick - last_tick >= 100)
+        if (tick - ctx->last_tick >= 100)
         {
-            last_tick = tick;
+            ctx->last_tick = tick;
             {
                 /* check for engine event */
-                poll_event(0);
-                if (main_event.any)
+                if (ctx->poll != NULL)
+                {
+                    ctx->poll(0);
+                }
+                if (ctx->event->any)
                 {
                     debugf("pv_search event occurred ply=%d depth=%d\n",
                            ply, depth);
@@ -280,18 +384,18 @@ static s32 pv_search(bitboard *bb, int ply, int depth, s32 alpha, s32 beta)
     bestmove = 0;
     if (depth > 0) /* no tt probing in quiescence search / leaf nodes, */
     {              /* the memory read stalls are too expensive */
-        ttprobe_count++;
+        tp->ttprobe_count++;
         if (probe_tt(bb, ply, depth, alpha, beta, &best, &bestmove))
         {
             debugf("probe_tt hit ply=%d depth=%d side=%d score=%d\n",
                    ply, depth, bb->side, best);
-            tthit_count++;
+            tp->tthit_count++;
             return best;
         }
     }
     if (bestmove != 0) /* probe_tt found move from lower depth entry */
     {
-        ttbest_count++;
+        tp->ttbest_count++;
     }
     alpha = best;      /* alpha may have been improved by probe_tt */
 
@@ -304,10 +408,25 @@ static s32 pv_search(bitboard *bb, int ply, int depth, s32 alpha, s32 beta)
         return best;
     }
 
-    /* when depth <= 0, generate capture moves only for quiescence search */
-    gen_moves(bb, &list, NULL, depth > 0);
+    /* generate the capture moves first; capturing is mandatory, so */
+    /* the non-capture moves are only needed if there are none, and */
+    /* not at all when depth <= 0 (quiescence search); they are only */
+    /* counted here, and generated after the staged moves, see below */
+    if (has_capt(bb))
+    {
+        gen_cmoves(bb, &list, FALSE);
+    }
+    else
+    {
+        list.count = list.npcapt = 0;
+    }
+    nmoves = list.count;
+    if (nmoves == 0 && depth > 0)
+    {
+        nmoves = count_noncapt(bb);
+    }
 
-    if (list.count == 0 && depth > 0)
+    if (nmoves == 0 && depth > 0)
     {
         /* side to move can't move */
         debugf("pv_search return ply=%d depth=%d side=%d nomove\n",
@@ -317,15 +436,15 @@ static s32 pv_search(bitboard *bb, int ply, int depth, s32 alpha, s32 beta)
 
     /* check WDL endgame database, except when we must capture */
     if (pcnt > DTWENDPC && pcnt <= MAXENDPC &&
-        (list.count == 0 ||                      /* quiescent leaf node */
-         (list.npcapt == 0 && pcnt <= db_maxpc)))/* non-capture interior node */
+        (nmoves == 0 ||                          /* quiescent leaf node */
+         (list.npcapt == 0 && pcnt <= ctx->db_maxpc))) /* non-capt. interior */
     {
         if (endgame_wdl(bb, &best))
         {
             debugf("pv_search wdl hit ply=%d depth=%d side=%d score=%d\n",
                    ply, depth, bb->side, best);
             if (depth <= 0 ||             /* quiescent leaf node */
-                abs(best) > db_threshold) /* win/loss score found */
+                abs(best) > ctx->db_threshold) /* win/loss score found */
             {
                 debugf("pv_search wdl cutoff\n");
                 return best;
@@ -333,7 +452,7 @@ static s32 pv_search(bitboard *bb, int ply, int depth, s32 alpha, s32 beta)
         }
     }
 
-    if (list.count == 0 || ply >= max_ply)
+    if (nmoves == 0 || ply >= ctx->max_ply)
     {
         /* quiescence search complete, arrived at leaf depth */
         return eval_board(bb);
@@ -347,7 +466,7 @@ static s32 pv_search(bitboard *bb, int ply, int depth, s32 alpha, s32 beta)
     if (depth > 2 && alpha + 1 == beta &&
         game_phase(pcnt) != 0 && beta < INFIN - MAXPLY - m)
     {
-        best = pv_search(bb, ply, depth/2, beta + m - 1, beta + m);
+        best = pv_search(tp, bb, ply, depth/2, beta + m - 1, beta + m);
         if (best >= beta + m)
         {
             return beta; /* fail-hard seems to work best here */
@@ -356,30 +475,86 @@ static s32 pv_search(bitboard *bb, int ply, int depth, s32 alpha, s32 beta)
 #endif
 
     d = depth;
+    nstaged = 0;
+    if (list.count == 0) /* no captures, non-capture moves to be generated */
+    {
+        /* a tt best move with a capture hash can only come from a */
+        /* false signature match here; drop it, so that stage_moves */
+        /* and sort_moves agree on which moves are staged */
+        if (bestmove >> TTCAPTSHIFT != 0)
+        {
+            bestmove = 0;
+        }
+        /* try the tt best move and killers first, in the cases that */
+        /* sort_moves puts them first, unless all moves are needed */
+        /* right away by the etc below */
+        if (nmoves > 1 && (bestmove != 0 || d - 1 > 2)
+#ifdef ETC
+            && !(d - 1 > 4 && alpha + 1 == beta)
+#endif
+            )
+        {
+            nstaged = stage_moves(bb, &list, bestmove, &tp->killer_list[ply]);
+        }
+        if (nstaged == 0)
+        {
+            gen_cmoves_noncapt(bb, &list);
+        }
+        else
+        {
+            tp->stage_count++;
+            list.count = nmoves; /* entries nstaged.. are filled in later */
+        }
+    }
+
     if (list.count > 1)
     {
         d--;
 
-        /* order moves best-first */
-        sort_moves(&list, d, bestmove, &killer_list[ply]);
+#if defined(PF) && defined(ETC)
+        /* the etc below probes all children; request all their tt */
+        /* cache lines now, so that the memory reads overlap with each */
+        /* other and with the move sorting */
+        if (d > 4 && alpha + 1 == beta)
+        {
+            prefetch_tt_moves(bb, &list, 0, list.count);
+        }
+#endif
+
+        /* order moves best-first (staged moves are in order already) */
+        if (nstaged == 0)
+        {
+            sort_moves(&list, d, bestmove, &tp->killer_list[ply],
+                       tp->good_hist);
+        }
+
+#ifdef PF
+        /* the tt best move's board position will be probed soon, */
+        /* prefetch its tt entry cache line */
+        if (bestmove != 0 && d > 0)
+        {
+            prefetch_tt_moves(bb, &list, 0, 1);
+        }
+#endif
 
 #ifdef ETC
         /* enhanced transposition cutoffs */
         /* not too close to leaf depth, and not in pv nodes */
         if (d > 4 && alpha + 1 == beta)
         {
-            etctst_count++;
+            tp->etctst_count++;
             for (m = 0; m < list.count; m++)
             {
                 /* see if move leads to a position in the tt */
-                if (probe_tt(&list.move[m], ply + 1, d, -beta, -alpha, &best, NULL))
+                make_move(bb, &list.move[m], &child);
+                if (probe_tt(&child, ply + 1, d, -beta, -alpha, &best, NULL))
                 {
-                    etchit_count++;
+                    tp->etchit_count++;
                     best = -best;
                     /* check for beta cutoff */
                     if (best >= beta)
                     {
-                        etccut_count++;
+                        tp->etccut_count++;
                         debugf("pv_search ETC cut ply=%d depth=%d side=%d "
                                "score=%d\n", ply, depth, bb->side, best);
                         return best;
@@ -391,14 +566,16 @@ static s32 pv_search(bitboard *bb, int ply, int depth, s32 alpha, s32 beta)
     }
 
     /* build next tree level */
-    nonleaf_count++;
+    tp->nonleaf_count++;
 
+    /* the child boards are only materialized when they are searched */
     debugf("pv_search first move\n");
-    best = -pv_search(&list.move[0], ply + 1, d, -beta, -alpha);
+    make_move(bb, &list.move[0], &child);
+    best = -pv_search(tp, &child, ply + 1, d, -beta, -alpha);
     bestm = 0;
 
     /* check for engine event received at greater depth */
-    if (main_event.any)
+    if (search_aborted(tp))
     {
         debugf("pv_search abort after first move ply=%d depth=%d\n",
                ply, depth);
@@ -418,17 +595,27 @@ static s32 pv_search(bitboard *bb, int ply, int depth, s32 alpha, s32 beta)
             alpha = best;
         }
 
+        if (m == nstaged)
+        {
+            /* no cutoff by the staged moves; generate and order all */
+            /* non-capture moves, which puts the staged ones in front */
+            gen_cmoves_noncapt(bb, &list);
+            sort_moves(&list, d, bestmove, &tp->killer_list[ply],
+                       tp->good_hist);
+        }
+        make_move(bb, &list.move[m], &child);
+
 #ifdef LMR
         /* late move reductions */
         merit = alpha + 1; /* to do the full search if not reduced */
         if (m >= 3 && alpha + 1 == beta && d > 2 && pcnt >= 8)
         {
             /* reduced depth zero width window search */
-            merit = -pv_search(&list.move[m], ply + 1, d - 1 - (m >= 6), 
+            merit = -pv_search(tp, &child, ply + 1, d - 1 - (m >= 6), 
                                -alpha - 1, -alpha);
 
             /* check for engine event received at greater depth */
-            if (main_event.any)
+            if (search_aborted(tp))
             {
                 debugf("pv_search abort after lmr search ply=%d depth=%d\n",
                        ply, depth);
@@ -439,10 +626,11 @@ static s32 pv_search(bitboard *bb, int ply, int depth, s32 alpha, s32 beta)
 #endif
         {
             /* full depth zero width window search */
-            merit = -pv_search(&list.move[m], ply + 1, d, -alpha - 1, -alpha);
+            merit = -pv_search(tp, &child, ply + 1, d,
+                               -alpha - 1, -alpha);
 
             /* check for engine event received at greater depth */
-            if (main_event.any)
+            if (search_aborted(tp))
             {
                 debugf("pv_search abort after 0-width search ply=%d depth=%d\n",
                        ply, depth);
@@ -460,10 +648,10 @@ static s32 pv_search(bitboard *bb, int ply, int depth, s32 alpha, s32 beta)
             {
                 /* new PV, re-search with full window */
                 debugf("pv_search re-search\n");
-                merit = -pv_search(&list.move[m], ply + 1, d, -beta, -best);
+                merit = -pv_search(tp, &child, ply + 1, d, -beta, -best);
 
                 /* check for engine event received at greater depth */
-                if (main_event.any)
+                if (search_aborted(tp))
                 {
                     debugf("pv_search abort after re-search ply=%d depth=%d\n",
                            ply, depth);
@@ -478,17 +666,22 @@ static s32 pv_search(bitboard *bb, int ply, int depth, s32 alpha, s32 beta)
         }
     }
 
-    fromto = move_square(&list.move[bestm], FROMTO);
+    if (nstaged != 0 && m <= nstaged && best >= beta)
+    {
+        tp->stagecut_count++; /* cutoff before generating the other moves */
+    }
+
+    fromto = cmove_square(&list.move[bestm], FROMTO);
 
 #ifdef KIL
     if (best >= beta && list.count > 1)
     {
 
         /* save as a killer */
-        if (killer_list[ply].k1 != fromto)
+        if (tp->killer_list[ply].k1 != fromto)
         {
-            killer_list[ply].k2 = killer_list[ply].k1;
-            killer_list[ply].k1 = fromto;
+            tp->killer_list[ply].k2 = tp->killer_list[ply].k1;
+            tp->killer_list[ply].k1 = fromto;
         }
     }
 #endif
@@ -496,16 +689,15 @@ static s32 pv_search(bitboard *bb, int ply, int depth, s32 alpha, s32 beta)
     if (depth > 1 && best > origalpha)
     {
         /* save in history of good moves */
-        good_hist[fromto] += (depth - 1)*(depth - 1);
+        tp->good_hist[fromto] += (depth - 1)*(depth - 1);
     }
 
     if (depth > 0)
     {
-        /* collapse the best move (to save space in the tt) */
-        bestmove = list.move[bestm].white | list.move[bestm].black;
-
-        /* save score and move in transposition table */
-        store_tt(bb, ply, depth, origalpha, beta, best, bestmove);
+        /* save score and move (as from/to pair with capture hash) */
+        /* in transposition table */
+        store_tt(bb, ply, depth, origalpha, beta, best,
+                 fromto | (tt_capthash(list.move[bestm].capt) << TTCAPTSHIFT));
     }
 
     debugf("pv_search return ply=%d depth=%d side=%d score=%d\n",
@@ -515,37 +707,38 @@ static s32 pv_search(bitboard *bb, int ply, int depth, s32 alpha, s32 beta)
 
 /* set time budget */
 /* depending on game phase and worsening or improving score */
+/* ctx -> search context */
 /* bb -> current board */
 /* m = index number of the move in the move list, use -m for re-search */
 /* score = current score */
 /* start = score at start of search */
-static void set_budget(bitboard *bb, int m, s32 score, s32 start)
+static void set_budget(srchctx *ctx, bitboard *bb, int m, s32 score, s32 start)
 {
-    m_explored = abs(m); /* save move index for result display */
+    ctx->m_explored = abs(m); /* save move index for result display */
 
     if (score < start - VAL_MAN/10)
     {
         /* try to think our way out of trouble */
-        think_time = 3*move_time;
+        ctx->think_time = 3*ctx->move_time;
         return;
     }
 
-    think_time = move_time;
+    ctx->think_time = ctx->move_time;
     if (game_phase(popcount(bb->white | bb->black)) == 0)
     {
         /* opening, conserve time */
-        think_time = think_time/2;
+        ctx->think_time = ctx->think_time/2;
     }
 
     switch (m)
     {
     case 0:        /* try to finish the PV and the runner-up */
     case 1:
-        think_time = 2*think_time;
+        ctx->think_time = 2*ctx->think_time;
         break;
     case -1:       /* re-search of runner-up */
     case 2:        /* search of second runner-up */
-        think_time = 3*think_time/2;
+        ctx->think_time = 3*ctx->think_time/2;
         break;
     default:
         /* no extra time for the rest, including other re-searches */
@@ -555,26 +748,31 @@ static void set_budget(bitboard *bb, int m, s32 score, s32 start)
     if (score > start + 7*VAL_MAN/5)
     {
         /* things are going well */
-        think_time = 2*think_time/3;
+        ctx->think_time = 2*ctx->think_time/3;
     }
 }
 
 /* do the root-level principal variation search */
 /* moves have already been generated by the caller */
+/* only the main thread manages the time budget and reports progress */
+/* tp -> search thread data */
 /* depth = depth of tree to build */
 /* listptr -> move list; the best move will be put in front */
 /* out: scores -> values of individual moves in the move list, same order */
-static void pv_search0(int depth, movelist *listptr, s32 *scores)
+static void pv_search0(srchthrd *tp, int depth, movelist *listptr, s32 *scores)
 {
+    srchctx *ctx = tp->ctx;
     bitboard move;
     lnentry moveln;
     s32 alpha, beta, best, merit;
     int d, m;
+    bool report;
 
-    node_count++;
+    tp->node_count++;
+    report = ctx->verbose && tp->id == 0;
 
 #ifdef _DEBUG
-    if (debug_info)
+    if (debug_info && tp->id == 0)
     {
         printf("pv_search0 ");
         for (m = 0; m < listptr->count; m++)
@@ -597,22 +795,25 @@ static void pv_search0(int depth, movelist *listptr, s32 *scores)
     }
 
     /* adjust time budget */
-    set_budget(&listptr->move[0], 0, scores[0], iter0_score);
+    if (tp->id == 0)
+    {
+        set_budget(ctx, &listptr->move[0], 0, scores[0], ctx->iter0_score);
+    }
 
     /* build first tree level */
-    nonleaf_count++;
+    tp->nonleaf_count++;
     alpha = -INFIN;
     beta = INFIN;
-    best = -pv_search(&listptr->move[0], 1, d, -beta, -alpha);
+    best = -pv_search(tp, &listptr->move[0], 1, d, -beta, -alpha);
 
     /* check for engine event received at greater depth */
-    if (main_event.any)
+    if (search_aborted(tp))
     {
         debugf("pv_search0 abort first move\n");
         return;
     }
 
-    if (verbose_info)
+    if (report)
     {
         printf("%d.%d score=%d pv=", depth, 0, best);
         print_pv(&listptr->move[0]);
@@ -631,13 +832,16 @@ static void pv_search0(int depth, movelist *listptr, s32 *scores)
         }
 
         /* adjust time budget */
-        set_budget(&listptr->move[m], m, best, iter0_score);
+        if (tp->id == 0)
+        {
+            set_budget(ctx, &listptr->move[m], m, best, ctx->iter0_score);
+        }
 
         /* zero width window search */
-        merit = -pv_search(&listptr->move[m], 1, d, -alpha - 1, -alpha);
+        merit = -pv_search(tp, &listptr->move[m], 1, d, -alpha - 1, -alpha);
 
         /* check for engine event received at greater depth */
-        if (main_event.any)
+        if (search_aborted(tp))
         {
             debugf("pv_search0 abort 0-width search\n");
             return;
@@ -648,7 +852,7 @@ static void pv_search0(int depth, movelist *listptr, s32 *scores)
         {
             /* found a new best move */
             best = merit;
-            if (verbose_info)
+            if (report)
             {
                 printf("%d.%d merit=%d pv=", depth, m, merit);
                 print_pv(&listptr->move[m]);
@@ -671,16 +875,20 @@ static void pv_search0(int depth, movelist *listptr, s32 *scores)
             if (m < listptr->count - 1)
             {
                 /* adjust time budget */
-                set_budget(&listptr->move[0], -m, best, iter0_score);
+                if (tp->id == 0)
+                {
+                    set_budget(ctx, &listptr->move[0], -m, best,
+                               ctx->iter0_score);
+                }
 
-                if (verbose_info)
+                if (report)
                 {
                     printf("%d.%d re-search\n", depth, m);
                 }
-                merit = -pv_search(&listptr->move[0], 1, d, -beta, -best);
+                merit = -pv_search(tp, &listptr->move[0], 1, d, -beta, -best);
 
                 /* check for engine event received at greater depth */
-                if (main_event.any)
+                if (search_aborted(tp))
                 {
                     debugf("pv_search0 abort re-search\n");
                     return;
@@ -692,7 +900,7 @@ static void pv_search0(int depth, movelist *listptr, s32 *scores)
                 }
                 scores[0] = best;
             }
-            if (verbose_info)
+            if (report)
             {
                 printf("%d.%d new best=%d pv=", depth, m, best);
                 print_pv(&listptr->move[0]);
@@ -700,7 +908,7 @@ static void pv_search0(int depth, movelist *listptr, s32 *scores)
         }
         else
         {
-            if (verbose_info)
+            if (report)
             {
                 printf("%d.%d score=%d move=", depth, m, merit);
                 print_move(&listptr->move[m]);
@@ -708,10 +916,10 @@ static void pv_search0(int depth, movelist *listptr, s32 *scores)
             }
         }
     }
-    if (verbose_info)
+    if (report)
     {
         printf("%d.complete, %u ms, score=%d move=",
-               depth, get_tick() - start_tick, scores[0]);
+               depth, get_tick() - ctx->start_tick, scores[0]);
         print_move(&listptr->move[0]);
         printf("\n");
     }
@@ -723,13 +931,11 @@ static void pv_search0(int depth, movelist *listptr, s32 *scores)
 /* returns: TRUE if OK, FALSE if storage exceeded */
 static bool equiv_search(bitboard *bb, poslist *posptr)
 {
-    movelist list;
+    cmovelist list;
+    bitboard child;
     int m;
 
-    /* generate capture moves only */
-    gen_moves(bb, &list, NULL, FALSE);
-
-    if (list.count == 0)
+    if (!has_capt(bb))
     {
         /* arrived at leaf depth, add this board to the list */
         if (posptr->count >= elements(posptr->pos))
@@ -742,9 +948,11 @@ static bool equiv_search(bitboard *bb, poslist *posptr)
         return TRUE;
     }
     /* do the next level of captures */
+    gen_cmoves(bb, &list, FALSE);
     for (m = 0; m < list.count; m++)
     {
-        if (!equiv_search(&list.move[m], posptr)) /* recurse */
+        make_move(bb, &list.move[m], &child);
+        if (!equiv_search(&child, posptr)) /* recurse */
         {
             return FALSE;
         }
@@ -798,19 +1006,96 @@ static bool equiv_captures(movelist *listptr)
     return TRUE;
 }
 
+/* helper thread main function */
+/* does its own iterative deepening on a copy of the root moves, */
+/* sharing results with the main thread only through the tt */
+/* arg -> search thread data */
+/* returns: NULL */
+static void *helper_search(void *arg)
+{
+    srchthrd *tp = (srchthrd *) arg;
+    int d;
+
+    end_cache = (tp->wdlc.sets != 0) ? &tp->wdlc : NULL;
+    /* odd numbered helpers run one iteration ahead, to diversify the trees */
+    for (d = 1 + (tp->id & 1); d <= tp->maxdepth; d++)
+    {
+        pv_search0(tp, d, &tp->list, tp->scores);
+        if (tp->ctx->abort)
+        {
+            break; /* out of iteration */
+        }
+        tp->depth = d;
+    }
+
+    /* hand over the thread-local statistics */
+    tp->gencalls = moves_gencalls;
+    tp->generated = moves_generated;
+    tp->evals = eval_count;
+    memcpy(tp->endacc, end_acc, sizeof tp->endacc);
+    memcpy(tp->endblk, end_blk, sizeof tp->endblk);
+    memcpy(tp->endprobes, end_probes, sizeof tp->endprobes);
+    return NULL;
+}
+
+/* start the helper threads of a lazy smp search */
+/* ctx -> search context */
+/* listptr -> root move list */
+/* maxdepth = ultimate iterative search depth */
+static void start_helpers(srchctx *ctx, movelist *listptr, int maxdepth)
+{
+    srchthrd *tp;
+    int t;
+
+    ctx->abort = FALSE;
+    for (t = 1; t < ctx->nthreads; t++)
+    {
+        tp = &ctx->threads[t];
+        tp->maxdepth = maxdepth;
+        tp->list = *listptr;
+        tp->list.lnptr = NULL; /* helpers don't reorder the long notation */
+        if (!start_thread(&tp->handle, helper_search, tp))
+        {
+            printf("can't start search thread %d\n", t);
+            break; /* out of for loop */
+        }
+    }
+    ctx->helpers_started = t - 1;
+}
+
+/* stop the helper threads and wait for them to finish */
+/* ctx -> search context */
+static void stop_helpers(srchctx *ctx)
+{
+    int t;
+
+    ctx->abort = TRUE;
+    for (t = 1; t <= ctx->helpers_started; t++)
+    {
+        join_thread(ctx->threads[t].handle);
+    }
+    ctx->helpers_started = 0;
+}
+
 /* let engine determine the next move to be made */
+/* ctx -> search context */
 /* listptr -> move list; the best move will be put in front */
 /* maxdepth = ultimate iterative search depth */
-void engine_think(movelist *listptr, int maxdepth)
+void engine_think(srchctx *ctx, movelist *listptr, int maxdepth)
 {
     bitboard *bb;
+    srchthrd *tp, *mp = &ctx->threads[0];
     s32 scores[elements(listptr->move)];
     s32 best, nextbest;
-    int d, m;
+    u64 nodes, nonleafs, ttprobes, tthits, ttbests, etctsts, etchits, etccuts;
+    u64 stages, stagecuts;
+    int d, m, t;
 
     scores[0] = 0;
-    start_tick = last_tick = get_tick();
-    fade_hist();
+    ctx->start_tick = ctx->last_tick = get_tick();
+    ctx->pondering = FALSE;
+    reset_threads(ctx);
+    age_tt();
 
     if (get_bookmove(listptr))
     {
@@ -831,46 +1116,48 @@ void engine_think(movelist *listptr, int maxdepth)
         moves_generated = listptr->count;
 
         /* clear statistics counts */
-        node_count = nonleaf_count = 0;
-        ttprobe_count = tthit_count = ttbest_count = 0;
-        etctst_count = etchit_count = etccut_count = 0;
         end_acc[0] = end_acc[2] = end_acc[3] = 0;
         end_acc[4] = end_acc[5] = end_acc[6] = 0;
+        end_blk[0] = end_blk[1] = 0;
         eval_count = 0;
-        memset(killer_list, 0, sizeof killer_list);
 
         /* get a first approximation of the score */
         bb = listptr->move[0].parent;
-        if (!endgame_value(bb, 0, &iter0_score))
+        if (!endgame_value(bb, 0, &ctx->iter0_score))
         {
-            iter0_score = eval_board(bb);
+            ctx->iter0_score = eval_board(bb);
         }
-        scores[0] = iter0_score;
+        scores[0] = ctx->iter0_score;
 
         /* may cutoff at any 5- or 6-pc win/loss position encountered */
-        max_ply = MAXPLY;
-        db_threshold = INFIN - max_ply;
-        db_maxpc = 6;
+        ctx->max_ply = MAXPLY;
+        ctx->db_threshold = INFIN - ctx->max_ply;
+        ctx->db_maxpc = 6;
+
+        start_helpers(ctx, listptr, maxdepth);
 
         /* iterative deepening */
         for (d = 1; d <= maxdepth; d++)
         {
-            pv_search0(d, listptr, scores);
+            pv_search0(mp, d, listptr, scores);
 
             fflush(stdout);
 
-            if (main_event.movenow)
+            if (ctx->event->movenow)
             {
                 /* time is up, we have to make a move */
-                main_event.movenow = FALSE;
+                ctx->event->movenow = FALSE;
                 break; /* out of iteration */
             }
-            if (main_event.any)
+            if (ctx->event->any)
             {
                 /* search was interrupted */
+                stop_helpers(ctx);
                 return;
             }
-            if (test_depth != 0 && d >= test_depth)
+            ctx->depth_tick[d] = get_tick() - ctx->start_tick;
+            mp->depth = d;
+            if (ctx->test_depth != 0 && d >= ctx->test_depth)
             {
                 /* depth limit reached */
                 break; /* out of iteration */
@@ -903,7 +1190,7 @@ void engine_think(movelist *listptr, int maxdepth)
                 break; /* no need for another iteration */
             }
 
-            if (abs(scores[0]) > db_threshold)
+            if (abs(scores[0]) > ctx->db_threshold)
             {
                 /* found a winning/losing move from wdl database, */
                 /* search in next iteration for a quicker win / slower loss */
@@ -911,36 +1198,110 @@ void engine_think(movelist *listptr, int maxdepth)
                 if (abs(scores[0]) < INFIN - MAX5PLY)
                 {
                     /* 6-pc win/loss found, now cutoff at any 5-pc win/loss */
-                    max_ply = MAX5PLY;
-                    db_maxpc = 5;
+                    ctx->max_ply = MAX5PLY;
+                    ctx->db_maxpc = 5;
                 }
                 else
                 {
                     /* 5-pc win/loss found, now keep searching for dtw */
-                    max_ply = MAXEXACT;
-                    db_maxpc = 4;
+                    ctx->max_ply = MAXEXACT;
+                    ctx->db_maxpc = 4;
                 }
-                db_threshold = INFIN - max_ply;
+                ctx->db_threshold = INFIN - ctx->max_ply;
                 printf("entering iteration %d with threshold=%d maxply=%d\n",
-                       d + 1, db_threshold, max_ply);
+                       d + 1, ctx->db_threshold, ctx->max_ply);
+            }
+        }
+
+        stop_helpers(ctx);
+
+        /* add up the statistics of all threads */
+        mp->gencalls = moves_gencalls;
+        mp->generated = moves_generated;
+        mp->evals = eval_count;
+        memcpy(mp->endacc, end_acc, sizeof mp->endacc);
+        memcpy(mp->endblk, end_blk, sizeof mp->endblk);
+        nodes = nonleafs = ttprobes = tthits = ttbests = 0;
+        etctsts = etchits = etccuts = 0;
+        stages = stagecuts = 0;
+        for (t = 0; t < ctx->nthreads; t++)
+        {
+            tp = &ctx->threads[t];
+            nodes += tp->node_count;
+            nonleafs += tp->nonleaf_count;
+            ttprobes += tp->ttprobe_count;
+            tthits += tp->tthit_count;
+            ttbests += tp->ttbest_count;
+            etctsts += tp->etctst_count;
+            etchits += tp->etchit_count;
+            etccuts += tp->etccut_count;
+            stages += tp->stage_count;
+            stagecuts += tp->stagecut_count;
+            if (t > 0)
+            {
+                mp->gencalls += tp->gencalls;
+                mp->generated += tp->generated;
+                mp->evals += tp->evals;
+                for (m = 0; m < elements(tp->endacc); m++)
+                {
+                    mp->endacc[m] += tp->endacc[m];
+                }
+                mp->endblk[0] += tp->endblk[0];
+                mp->endblk[1] += tp->endblk[1];
+
+                /* select_wdlbits uses the probes of all threads */
+                for (m = 0; m < ENDFILES; m++)
+                {
+                    end_probes[m] += tp->endprobes[m];
+                }
+                memset(tp->endprobes, 0, sizeof tp->endprobes);
             }
         }
 
-        printf("reached depth=%d move=%d\n", d, m_explored);
+        printf("reached depth=%d move=%d\n", d, ctx->m_explored);
+        if (ctx->nthreads > 1)
+        {
+            printf("threads=%d helper depths=", ctx->nthreads);
+            for (t = 1; t < ctx->nthreads; t++)
+            {
+                printf("%s%d", (t > 1) ? "," : "", ctx->threads[t].depth);
+            }
+            printf("\n");
+        }
+        printf("time to depth ms=");
+        for (m = 1; m <= mp->depth; m++)
+        {
+            printf("%s%d:%u", (m > 1) ? " " : "", m, ctx->depth_tick[m]);
+        }
+        printf("\n");
         printf("nodes total=%" PRIu64 " nonleaf=%" PRIu64 " leaf=%" PRIu64 "\n",
-               node_count, nonleaf_count, node_count - nonleaf_count);
+               nodes, nonleafs, nodes - nonleafs);
         printf("moves calls=%" PRIu64 " generated=%" PRIu64 "\n",
-               moves_gencalls, moves_generated);
-        printf("tt probes=%" PRIu64 " hits=%" PRIu64 " bestmoves=%" PRIu64 "\n",
-               ttprobe_count, tthit_count, ttbest_count);
+               mp->gencalls, mp->generated);
+        printf("tt probes=%" PRIu64 " hits=%" PRIu64 " (%.1f%%) bestmoves=%"
+               PRIu64 " hashfull=%d\n", ttprobes, tthits,
+               (ttprobes != 0) ? 100.0*tthits/ttprobes : 0.0, ttbests,
+               hashfull_tt());
 #ifdef ETC
         printf("etc tests=%" PRIu64 " tthits=%" PRIu64 " cuts=%" PRIu64 "\n",
-               etctst_count, etchit_count, etccut_count);
+               etctsts, etchits, etccuts);
 #endif
+        printf("staged nodes=%" PRIu64 " cuts=%" PRIu64 " (%.1f%%)\n",
+               stages, stagecuts,
+               (stages != 0) ? 100.0*stagecuts/stages : 0.0);
         printf("egdb err=%" PRIu64 " 2pc=%" PRIu64 " 3pc=%" PRIu64 " 4pc=%"
-               PRIu64 " 5pc=%" PRIu64 " 6pc=%" PRIu64 "\n", end_acc[0],
-               end_acc[2], end_acc[3], end_acc[4], end_acc[5], end_acc[6]);
-        printf("evals=%" PRIu64 " score=%d\n", eval_count, scores[0]);
+               PRIu64 " 5pc=%" PRIu64 " 6pc=%" PRIu64 "\n",
+               mp->endacc[0], mp->endacc[2], mp->endacc[3],
+               mp->endacc[4], mp->endacc[5], mp->endacc[6]);
+        if (mp->wdlc.sets != 0)
+        {
+            printf("egdb block cache hits=%" PRIu64 " (%.1f%%) misses=%"
+                   PRIu64 "\n", mp->endblk[0],
+                   (mp->endblk[0] + mp->endblk[1] != 0) ?
+                   100.0*mp->endblk[0]/(mp->endblk[0] + mp->endblk[1]) : 0.0,
+                   mp->endblk[1]);
+        }
+        printf("evals=%" PRIu64 " score=%d\n", mp->evals, scores[0]);
     }
     return;
 }
@@ -948,10 +1309,11 @@ void engine_think(movelist *listptr, int maxdepth)
 /* let engine ponder while it is the opponent's turn; */
 /* this fills the transposition table, speeding up the */
 /* next search for our side */
+/* ctx -> search context */
 /* bb -> current board */
 /* maxdepth = ultimate iterative search depth */
 /* returns: TRUE if further pondering still useful */
-bool engine_ponder(bitboard *bb, int maxdepth)
+bool engine_ponder(srchctx *ctx, bitboard *bb, int maxdepth)
 {
     movelist list;
     s32 scores[elements(list.move)];
@@ -961,40 +1323,45 @@ bool engine_ponder(bitboard *bb, int maxdepth)
     gen_moves(bb, &list, NULL, TRUE);
     if (list.count == 0)
     {
-        if (verbose_info)
+        if (ctx->verbose)
         {
             printf("pondering but no moves\n");
         }
         return FALSE;
     }
-    start_tick = last_tick = get_tick();
-    fade_hist();
-    memset(killer_list, 0, sizeof killer_list);
+    ctx->start_tick = ctx->last_tick = get_tick();
+    ctx->pondering = TRUE;
+    reset_threads(ctx);
+    age_tt();
 
     /* may cutoff at any 5- or 6-pc win/loss position encountered */
-    max_ply = MAXPLY;
-    db_threshold = INFIN - max_ply;
-    db_maxpc = 6;
+    ctx->max_ply = MAXPLY;
+    ctx->db_threshold = INFIN - ctx->max_ply;
+    ctx->db_maxpc = 6;
+
+    start_helpers(ctx, &list, maxdepth);
 
     /* iterative deepening */
     for (d = 1; d <= maxdepth; d++)
     {
-        pv_search0(d, &list, scores);
+        pv_search0(&ctx->threads[0], d, &list, scores);
 
         fflush(stdout);
 
-        main_event.movenow = FALSE; /* not applicable for pondering */
-        if (main_event.any)
+        ctx->event->movenow = FALSE; /* not applicable for pondering */
+        if (ctx->event->any)
         {
+            stop_helpers(ctx);
             /* search was interrupted */
-            if (verbose_info)
+            if (ctx->verbose)
             {
-                printf("pondering aborted, event=%d\n", main_event.any);
+                printf("pondering aborted, event=%d\n", ctx->event->any);
             }
             return TRUE;
         }
     }
-    if (verbose_info)
+    stop_helpers(ctx);
+    if (ctx->verbose)
     {
         printf("pondering reached max depth\n");
     }
@@ -17,6 +17,79 @@
     along with Moby Dam.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-extern void clear_hist(void);
-extern void engine_think(movelist *listptr, int maxdepth);
-extern bool engine_ponder(bitboard *bb, int maxdepth);
+#define MAXTHREADS 64          /* max nr. of search threads */
+
+typedef struct {               /* killer store per ply */
+    int k1;
+    int k2;
+} kilst;
+
+typedef struct srchctx srchctx;
+
+typedef struct {               /* search data per thread */
+    srchctx *ctx;              /* search context the thread works for */
+    int id;                    /* thread number, 0 = main search thread */
+    thrd handle;               /* helper thread handle */
+    int maxdepth;              /* ultimate iterative search depth */
+    int depth;                 /* deepest iteration completed */
+    movelist list;             /* helper's own copy of the root moves */
+    s32 scores[128];           /* helper's root move scores */
+    kilst killer_list[MAXPLY + 1]; /* killer store for all plies */
+    u32 good_hist[51*51];      /* history of good moves */
+    wdlcache wdlc;             /* decoded egdb blocks, see wdl_cached */
+
+    /* statistics */
+    u64 node_count;            /* nr. of nodes visited */
+    u64 nonleaf_count;         /* nr. of non-leaf nodes visited */
+    u64 ttprobe_count;         /* nr. of tt probes */
+    u64 tthit_count;           /* nr. of tt hits */
+    u64 ttbest_count;          /* nr. of tt bestmoves */
+    u64 etctst_count;          /* nr. of etc tests */
+    u64 etchit_count;          /* nr. of etc hits */
+    u64 etccut_count;          /* nr. of etc cutoffs */
+    u64 stage_count;           /* nr. of nodes with staged moves */
+    u64 stagecut_count;        /* nr. of cutoffs before full generation */
+    u64 gencalls;              /* helper's nr. of move generator calls */
+    u64 generated;             /* helper's nr. of moves generated */
+    u64 evals;                 /* helper's nr. of board evaluations */
+    u64 endacc[7];             /* helper's egdb access counts */
+    u64 endblk[2];             /* helper's egdb block cache hits, misses */
+    u64 endprobes[ENDFILES];   /* helper's wdl probes per egdb file */
+} srchthrd;
+
+/* search context; holds all state of one (possibly multithreaded) */
+/* search, so that independent searches can run in the same process, */
+/* sharing only the transposition table and the endgame databases */
+struct srchctx {
+    /* settings, filled in by the caller */
+    mev *event;                /* events that terminate the search */
+    void (*poll)(int wait);    /* checks for new events, or NULL */
+    bool verbose;              /* print verbose search info */
+    u32 move_time;             /* nominal think time (ms) */
+    u32 test_time;             /* max search time per move (ms), or 0 */
+    int test_depth;            /* max iterative search depth, or 0 */
+
+    /* search threads */
+    int nthreads;              /* nr. of search threads, including main */
+    srchthrd *threads;         /* search data of main and helper threads */
+    int helpers_started;       /* nr. of helper threads running */
+    volatile bool abort;       /* tells the helper threads to stop */
+
+    /* search state */
+    bool pondering;            /* searching in opponent's time */
+    s32 iter0_score;           /* static root value before iterations start */
+    int max_ply;               /* maximum ply to search */
+    int db_maxpc;              /* maximum piece count for wdl lookup */
+    s32 db_threshold;          /* egdb win/loss score cutoff threshold */
+    int m_explored;            /* index of move being searched at ply 0 */
+    u32 start_tick;            /* time tick at start of search */
+    u32 last_tick;             /* most recent time tick */
+    u32 think_time;            /* time budget in milliseconds */
+    u32 depth_tick[MAXPLY + 1];/* time at which each iteration completed */
+};
+
+extern bool init_search(srchctx *ctx, int nthreads, u32 cache_kib,
+                        mev *event, void (*poll)(int wait));
+extern void clear_hist(srchctx *ctx);
+extern void engine_think(srchctx *ctx, movelist *listptr, int maxdepth);
+extern bool engine_ponder(srchctx *ctx, bitboard *bb, int maxdepth);
@@ -610,7 +610,7 @@ static void save_book(char *bookfile)
     }
     qsort(book_positions, book_newsize, sizeof(bitboard),
           (__compar_fn_t) bb_compare);
-    size = fwrite(book_positions, sizeof(bitboard), book_newsize, fp);
+    size = write_book(fp, book_positions, book_newsize);
     fclose(fp);
     if (size != book_newsize)
     {
@@ -0,0 +1,306 @@
+/*
+    Copyright 2015 Harm Jetten
+
+    This file is part of Moby Dam.
+
+    Moby Dam is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Moby Dam is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Moby Dam.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* endbench.c: measure the speed of endgame database probes; */
+/* for 5 and 6 pieces with the plain wdl decoder, the table-driven one, */
+/* the block cache and a bitbase, for 2 to 4 pieces compressed and unpacked */
+
+#include "test.h"
+
+bool debug_info = FALSE;
+char db_dirs[PATH_MAX] = ".";  /* directory/ies of database files */
+int end_pc[6];                 /* piece types of the endgame */
+int npc;                       /* nr. of pieces */
+u32 seed = 2463534242U;        /* state of the random number generator */
+
+/* simple pseudo-random number generator (xorshift) */
+/* returns: next pseudo-random number */
+static u32 next_rand(void)
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+/* check that a man isn't on its promotion row */
+/* pcbit = position of the piece */
+/* pc = piece type */
+/* returns: TRUE if the piece may stand there */
+static bool allowed(u64 pcbit, int pc)
+{
+    return !((pc == MW && (pcbit & ROW1) != 0) ||
+             (pc == MB && (pcbit & ROW10) != 0));
+}
+
+/* set up a random position of the endgame, without captures */
+/* out: bb -> the board */
+static void random_board(bitboard *bb)
+{
+    int i, sq;
+
+    do {
+        empty_board(bb);
+        bb->side = (end_pc[0] == MW || end_pc[0] == KW) ? W : B;
+        for (i = 0; i < npc; i++)
+        {
+            do {
+                sq = 1 + next_rand()%50;
+            } while (!allowed(conv_to_bit(sq), end_pc[i]) ||
+                     !place_piece(bb, sq, end_pc[i]));
+        }
+    } while (has_capt(bb));
+}
+
+/* move a random piece one step in a random direction, if possible, */
+/* so that successive probes hit nearby positions as in a search */
+/* bb -> the board */
+static void random_step(bitboard *bb)
+{
+    static const int shift[4] = { 6, 5, -5, -6 };
+    bitboard next;
+    u64 pieces, pcbit, tobit, *own;
+    int n, d;
+
+    next = *bb;
+    pieces = next.white | next.black;
+    n = next_rand()%npc;
+    while (n-- > 0)
+    {
+        pieces &= pieces - 1;
+    }
+    pcbit = pieces & -pieces;
+    d = shift[next_rand()%4];
+    tobit = (d > 0) ? pcbit << d : pcbit >> -d;
+    if ((tobit & ALL50 & ~(next.white | next.black)) == 0)
+    {
+        return;
+    }
+    own = ((pcbit & next.white) != 0) ? &next.white : &next.black;
+    if ((pcbit & next.kings) == 0 &&
+        !allowed(tobit, (own == &next.white) ? MW : MB))
+    {
+        return;
+    }
+    *own ^= pcbit | tobit;
+    if ((pcbit & next.kings) != 0)
+    {
+        next.kings ^= pcbit | tobit;
+    }
+    if (!has_capt(&next))
+    {
+        *bb = next;
+    }
+}
+
+/* probe all positions, and time it */
+/* pos -> the positions */
+/* n = nr. of positions */
+/* out: val -> values found, or -1 if none */
+/* returns: elapsed seconds */
+static double probe_all(bitboard *pos, int n, s32 *val)
+{
+    struct timeval tv1, tv2;
+    int i;
+
+    gettimeofday(&tv1, NULL);
+    for (i = 0; i < n; i++)
+    {
+        if (!((npc > DTWENDPC) ? endgame_wdl(&pos[i], &val[i]) :
+                                 endgame_dtw(&pos[i], 0, &val[i])))
+        {
+            val[i] = -1;
+        }
+    }
+    gettimeofday(&tv2, NULL);
+    return tv2.tv_sec - tv1.tv_sec + (tv2.tv_usec - tv1.tv_usec)/1000000.0;
+}
+
+/* the program entry point */
+int main(int argc, char *argv[])
+{
+    int i, opt, pc, n = 1000000, walk = 256, mismatch;
+    u32 kib = 16384;
+    bitboard brd, *pos;
+    s32 *val0, *val1, *val2, *val3;
+    double t0, t1, t2, t3;
+    wdlcache cache;
+
+    while (TRUE)
+    {
+        opt = getopt(argc, argv, "e:n:r:s:w:");
+        if (opt == -1)
+        {
+            break;
+        }
+        switch (opt)
+        {
+        case 'e':
+            strncpy(db_dirs, optarg, sizeof db_dirs - 1);
+            break;
+        case 'n':
+            n = atoi(optarg);
+            break;
+        case 'r':
+            walk = atoi(optarg);
+            break;
+        case 's':
+            seed = strtoul(optarg, NULL, 10);
+            break;
+        case 'w':
+            kib = atoi(optarg);
+            break;
+        default:
+            printf("Usage: %s [-e dbdir] [-n count] [-r steps] [-s seed] "
+                   "[-w kib] piecelist\n", argv[0]);
+            printf("  -e dbdir = directory holding database files\n"
+                   "       (or multiple colon-separated directories)\n"
+                   "       (default: current directory)\n"
+                   "  -n count = nr. of probes (default is 1000000)\n"
+                   "  -r steps = random walk length from each random\n"
+                   "       position, 1 = all random (default is 256)\n"
+                   "  -s seed = random seed, non-zero\n"
+                   "  -w kib = block cache size in KiB (default is 16384)\n"
+                   "  piecelist = two to six pieces, e.g. wWbBBB\n"
+                   "       (side to move is color of first piece)\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (npc = 0; optind < argc && npc < 6; npc++)
+    {
+        pc = argv[optind][npc];
+        if (pc == 'w')
+        {
+            end_pc[npc] = MW;
+        }
+        else if (pc == 'W')
+        {
+            end_pc[npc] = KW;
+        }
+        else if (pc == 'b')
+        {
+            end_pc[npc] = MB;
+        }
+        else if (pc == 'B')
+        {
+            end_pc[npc] = KB;
+        }
+        else
+        {
+            break; /* out of for loop */
+        }
+    }
+    if (npc < 2 || n < 1 || walk < 1 || seed == 0)
+    {
+        printf("give two to six pieces and valid options, see %s -h\n",
+               argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    init_enddb(db_dirs);
+    if (!init_wdlcache(&cache, kib))
+    {
+        printf("cache memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    pos = malloc(n*sizeof(bitboard));
+    val0 = malloc(n*sizeof(s32));
+    val1 = malloc(n*sizeof(s32));
+    val2 = malloc(n*sizeof(s32));
+    val3 = malloc(n*sizeof(s32));
+    if (pos == NULL || val0 == NULL || val1 == NULL || val2 == NULL ||
+        val3 == NULL)
+    {
+        printf("memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < n; i++)
+    {
+        if (i%walk == 0)
+        {
+            random_board(&brd);
+        }
+        else
+        {
+            random_step(&brd);
+        }
+        pos[i] = brd;
+    }
+
+    if (npc <= DTWENDPC)
+    {
+        /* first touch maps the db pages, as for the wdl runs */
+        probe_all(pos, n, val0);
+        t0 = probe_all(pos, n, val0);
+        unpack_enddb();
+        t1 = probe_all(pos, n, val1);
+        mismatch = 0;
+        for (i = 0; i < n; i++)
+        {
+            if (val0[i] != val1[i])
+            {
+                mismatch++;
+            }
+        }
+        printf("probes=%d walk=%d\n", n, walk);
+        printf("compressed: %.3f sec, %.0f probes/s, %.1f ns/probe\n",
+               t0, n/t0, 1e9*t0/n);
+        printf("unpacked:   %.3f sec, %.0f probes/s, %.1f ns/probe\n",
+               t1, n/t1, 1e9*t1/n);
+        printf("egdb err=%" PRIu64 " 2pc=%" PRIu64 " 3pc=%" PRIu64
+               " 4pc=%" PRIu64 " mismatches=%d\n", end_acc[0], end_acc[2],
+               end_acc[3], end_acc[4], mismatch);
+        return (mismatch == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    /* first touch maps the db pages, so that all runs find them */
+    end_cache = NULL;
+    end_refdecode = TRUE;
+    probe_all(pos, n, val0);
+    t0 = probe_all(pos, n, val0);
+    end_refdecode = FALSE;
+    t1 = probe_all(pos, n, val1);
+    end_cache = (cache.sets != 0) ? &cache : NULL;
+    t2 = probe_all(pos, n, val2);
+    end_cache = NULL;
+    select_wdlbits(1ULL << 32);
+    t3 = probe_all(pos, n, val3);
+
+    mismatch = 0;
+    for (i = 0; i < n; i++)
+    {
+        if (val0[i] != val1[i] || val0[i] != val2[i] || val0[i] != val3[i])
+        {
+            mismatch++;
+        }
+    }
+    printf("probes=%d walk=%d cache=%uKiB (%u blocks)\n",
+           n, walk, kib, cache.sets*WDLWAYS);
+    printf("plain decoder: %.3f sec, %.0f probes/s\n", t0, n/t0);
+    printf("decoder:       %.3f sec, %.0f probes/s\n", t1, n/t1);
+    printf("cache:         %.3f sec, %.0f probes/s, hits=%" PRIu64
+           " (%.1f%%) misses=%" PRIu64 "\n", t2, n/t2, end_blk[0],
+           (end_blk[0] + end_blk[1] != 0) ?
+           100.0*end_blk[0]/(end_blk[0] + end_blk[1]) : 0.0, end_blk[1]);
+    printf("bitbase:       %.3f sec, %.0f probes/s\n", t3, n/t3);
+    printf("egdb err=%" PRIu64 " 5pc=%" PRIu64 " 6pc=%" PRIu64
+           " mismatches=%d\n", end_acc[0], end_acc[5], end_acc[6], mismatch);
+
+    return (mismatch == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
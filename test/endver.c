@@ -21,7 +21,6 @@
 
 #include "test.h"
 
-extern u64 end_acc[7];         /* access statistics */
 extern s32 db_threshold;       /* egdb win/loss score cutoff threshold */
 
 bool debug_info = FALSE;
@@ -29,6 +28,8 @@ u64 end_tick;
 int end_pos[8];                /* for endgame verification */
 int end_pc[8] = {MW, MB, -1, -1, -1, -1, -1, -1};
 char db_dirs[PATH_MAX] = ".";  /* directory/ies of database files */
+bool decoder_check = FALSE;    /* compare the wdl decoders instead */
+u64 decoder_diffs;             /* nr. of wdl decoder differences */
 
 /* check position's egdb value against search value */
 /* bb -> the board */
@@ -50,12 +51,24 @@ static void comp_ce(bitboard *bb)
     }
     if (popcount(bb->white | bb->black) > DTWENDPC)
     {
-        gen_moves(bb, &list, NULL, FALSE);  /* generate captures only */
-        if (list.count != 0)
+        if (has_capt(bb))
         {
             return;                     /* skip when capture position */
         }
         b = endgame_wdl(bb, &v);
+        if (b && decoder_check)
+        {
+            end_refdecode = TRUE;
+            b = endgame_wdl(bb, &pvv);
+            end_refdecode = FALSE;
+            if (!b || pvv != v)
+            {
+                printf("decoder mismatch v=%d plain=%d\n", v, pvv);
+                print_board(bb);
+                decoder_diffs++;
+            }
+            return;
+        }
     }
     else
     {
@@ -151,7 +164,7 @@ int main(int argc, char *argv[])
 
     while (TRUE)
     {
-        opt = getopt(argc, argv, "cde:");
+        opt = getopt(argc, argv, "cde:r");
         if (opt == -1) 
         {
             break;
@@ -167,13 +180,20 @@ int main(int argc, char *argv[])
         case 'e':
             strncpy(db_dirs, optarg, sizeof db_dirs - 1);
             break;
+        case 'r':
+            decoder_check = TRUE;
+            break;
         default:
-            printf("Usage: %s [-c] [-d] [-e dbdir] piecelist\n", argv[0]);
+            printf("Usage: %s [-c] [-d] [-e dbdir] [-r] piecelist\n",
+                   argv[0]);
             printf("  -c = check endgame db file integrity\n"
                    "  -d = print lots of extra debug info\n"
                    "  -e dbdir = directory holding database files\n"
                    "       (or multiple colon-separated directories)\n"
                    "       (default: current directory)\n"
+                   "  -r = compare the table-driven wdl decoder with the\n"
+                   "       plain one, for all 5 and 6 piece positions\n"
+                   "       (instead of the search values)\n"
                    "  piecelist = two to six pieces, e.g. wWbBBB\n"
                    "       (side to move is color of first piece)\n");
             exit(EXIT_FAILURE);
@@ -219,6 +239,14 @@ int main(int argc, char *argv[])
     printf("egdb err=%" PRIu64 " 2pc=%" PRIu64 " 3pc=%" PRIu64 " 4pc=%" PRIu64
            " 5pc=%" PRIu64 " 6pc=%" PRIu64 "\n", end_acc[0], 
            end_acc[2], end_acc[3], end_acc[4], end_acc[5], end_acc[6]);
+    if (decoder_check)
+    {
+        printf("wdl decoder differences=%" PRIu64 "\n", decoder_diffs);
+        if (decoder_diffs != 0)
+        {
+            exit(EXIT_FAILURE);
+        }
+    }
 
     return EXIT_SUCCESS;
 }
@@ -21,26 +21,80 @@
 
 #include "test.h"
 
+#define MAXTHRD 64
+
+/* a perft hash entry; the check word is the key xor-ed with the */
+/* node count, so that an entry torn by concurrent stores from */
+/* multiple threads fails the key check */
+typedef struct {
+    u64 check;          /* key ^ nodes */
+    u64 nodes;          /* nr. of nodes in the subtree */
+} perftentry;
+
+/* a subtree to be counted by one of the threads */
+typedef struct {
+    bitboard brd;       /* board at the top of the subtree */
+    int root;           /* index of the root move it belongs to */
+    int depth;          /* remaining levels to generate */
+    u64 nodes;          /* out: nr. of nodes counted */
+} perftwork;
+
 bool debug_info = FALSE;
 bool bulk_counting = FALSE;
 
+perftentry *perft_table = NULL;     /* perft hash table, or NULL */
+u64 perft_mask;                     /* nr. of hash entries - 1 */
+
+perftwork *work;                    /* the subtrees to count */
+int work_count;                     /* nr. of subtrees */
+int work_next;                      /* next subtree to be picked up */
+
+/* hash key of a position at a given depth */
+/* bb -> current board */
+/* depth = remaining levels to generate */
+/* returns: key for the perft hash table */
+static u64 perft_key(bitboard *bb, int depth)
+{
+    return (bb->hash ^ ((bb->side == B) ? ZOBSIDE : 0)) +
+           depth*0x9e3779b97f4a7c15ULL;
+}
+
 /* build a tree and count the nodes */
 /* bb -> current board */
 /* depth = remaining levels to generate */
 /* returns: nr. of nodes generated */
 u64 perft(bitboard *bb, int depth)
 {
-    movelist list;
+    cmovelist list;
+    bitboard child;
+    perftentry *ep = NULL;
     int i;
-    u64 nodes;
+    u64 nodes, key = 0;
 
     if (depth == 0)
     {
         return 1;
     }
 
-    gen_moves(bb, &list, NULL, TRUE); /* generate all moves */
+    /* subtrees of depth 1 are cheaper to count than to look up */
+    if (perft_table != NULL && depth >= 2)
+    {
+        key = perft_key(bb, depth);
+        ep = &perft_table[key & perft_mask];
+        nodes = ep->nodes;
+        if ((ep->check ^ nodes) == key)
+        {
+            return nodes;
+        }
+    }
+
+    gen_cmoves(bb, &list, TRUE); /* generate all moves */
 
+    /* without bulk counting every leaf board is built by make_move, */
+    /* including its hash, as the search does for each node it visits; */
+    /* this is slower than when the generator wrote the boards itself, */
+    /* but the search doesn't build the children after a cutoff, so */
+    /* only this mode, which visits all children, pays for it */
     if (depth == 1 && bulk_counting)
     {
         return list.count;
@@ -54,34 +108,134 @@ u64 perft(bitboard *bb, int depth)
     nodes = 0;
     for (i = 0; i < list.count; i++)
     {
+        make_move(bb, &list.move[i], &child);
         if (debug_info)
         {
-            print_move(&list.move[i]);
+            print_move(&child);
             printf("\n");
         }
-        nodes += perft(&list.move[i], depth - 1); /* recurse */
+        nodes += perft(&child, depth - 1); /* recurse */
+    }
+
+    if (ep != NULL)
+    {
+        ep->check = key ^ nodes;
+        ep->nodes = nodes;
     }
 
     return nodes;
 }
 
+/* thread main function */
+/* counts subtrees until none are left */
+/* arg -> unused */
+/* returns: NULL */
+static void *perft_thread(void *arg)
+{
+    int w;
+
+    while ((w = __sync_fetch_and_add(&work_next, 1)) < work_count)
+    {
+        work[w].nodes = perft(&work[w].brd, work[w].depth);
+    }
+    return NULL;
+}
+
+/* count the nodes per root move, possibly with multiple threads */
+/* bb -> current board */
+/* depth = remaining levels to generate, at least 1 */
+/* nthreads = nr. of threads to use */
+/* out: listptr -> the root moves, with long notation in lnptr */
+/* out: rootnodes -> nr. of nodes per root move */
+/* returns: total nr. of nodes generated */
+u64 perft_root(bitboard *bb, int depth, int nthreads,
+               movelist *listptr, lnlist *lnptr, u64 *rootnodes)
+{
+    cmovelist list;
+    thrd handle[MAXTHRD];
+    int i, j, t;
+    u64 nodes;
+
+    gen_moves(bb, listptr, lnptr, TRUE);
+
+    /* split the tree into subtrees below the root moves, and if */
+    /* there are multiple threads one level deeper, to balance the */
+    /* load when the root moves are few */
+    work_count = 0;
+    for (i = 0; i < listptr->count; i++)
+    {
+        if (nthreads > 1 && depth >= 3)
+        {
+            gen_cmoves(&listptr->move[i], &list, TRUE);
+            for (j = 0; j < list.count; j++)
+            {
+                make_move(&listptr->move[i], &list.move[j],
+                          &work[work_count].brd);
+                work[work_count].root = i;
+                work[work_count].depth = depth - 2;
+                work_count++;
+            }
+        }
+        else
+        {
+            work[work_count].brd = listptr->move[i];
+            work[work_count].root = i;
+            work[work_count].depth = depth - 1;
+            work_count++;
+        }
+    }
+
+    work_next = 0;
+    if (nthreads > 1)
+    {
+        for (t = 0; t < nthreads; t++)
+        {
+            if (!start_thread(&handle[t], perft_thread, NULL))
+            {
+                printf("can't start thread %d\n", t);
+                exit(EXIT_FAILURE);
+            }
+        }
+        for (t = 0; t < nthreads; t++)
+        {
+            join_thread(handle[t]);
+        }
+    }
+    else
+    {
+        perft_thread(NULL);
+    }
+
+    nodes = 0;
+    memset(rootnodes, 0, listptr->count*sizeof(u64));
+    for (i = 0; i < work_count; i++)
+    {
+        rootnodes[work[i].root] += work[i].nodes;
+        nodes += work[i].nodes;
+    }
+    return nodes;
+}
+
 /* the program entry point */
 int main(int argc, char *argv[])
 {
-    int opt, d, dmax = 1;
-    u64 nodes;
+    int opt, d, i, dmax = 1, nthreads = 1, exp = 0;
+    bool portable = FALSE, divide = FALSE;
+    u64 nodes, rootnodes[128];
     struct timeval tv1, tv2;
     double interval;
     bitboard brd;
+    movelist list;
+    lnlist longnot;
 
     while (TRUE)
     {
-        opt = getopt(argc, argv, "bc:d");
-        if (opt == -1) 
+        opt = getopt(argc, argv, "bc:dj:pDH:");
+        if (opt == -1)
         {
             break;
         }
-        switch (opt) 
+        switch (opt)
         {
         case 'b':
             bulk_counting = TRUE;
@@ -92,15 +246,46 @@ int main(int argc, char *argv[])
         case 'd':
             debug_info = TRUE;
             break;
+        case 'j':
+            nthreads = atoi(optarg);
+            break;
+        case 'p':
+            portable = TRUE;
+            break;
+        case 'D':
+            divide = TRUE;
+            break;
+        case 'H':
+            exp = atoi(optarg);
+            break;
         default:
-            printf("Usage: %s [-b] [-c n] [-d] FEN\n", argv[0]);
+            printf("Usage: %s [-b] [-c n] [-d] [-j threads] [-p] [-D] "
+                   "[-H exp] FEN\n", argv[0]);
             printf("  -b = bulk counting (default is nobulk)\n"
                    "  -c n = depth count (default is 1)\n"
                    "  -d = print lots of extra debug info\n"
-                   "  FEN = initial board position\n");
+                   "  -j threads = nr. of threads, 1..%d (default is 1)\n"
+                   "  -p = use the portable move generator path\n"
+                   "       (default is the fastest one the cpu supports)\n"
+                   "  -D = divide: print the nr. of nodes per root move\n"
+                   "       at the last depth\n"
+                   "  -H exp = cache subtree counts in a hash table of\n"
+                   "       2^exp entries, 10..32 (default is no table)\n"
+                   "  FEN = initial board position\n", MAXTHRD);
             exit(EXIT_FAILURE);
         }
     }
+    if (nthreads < 1 || nthreads > MAXTHRD ||
+        (exp != 0 && (exp < 10 || exp > 32)))
+    {
+        printf("option out of range\n");
+        exit(EXIT_FAILURE);
+    }
+    if (nthreads > 1 && debug_info)
+    {
+        printf("debug info needs a single thread\n");
+        exit(EXIT_FAILURE);
+    }
 
     init_board(&brd);
     if (optind < argc)
@@ -111,15 +296,53 @@ int main(int argc, char *argv[])
         }
     }
     print_board(&brd);
+    printf("move generator uses %s path\n",
+           (portable) ? "portable" : init_movegen());
+
+    if (exp != 0)
+    {
+        perft_mask = (1ULL << exp) - 1;
+        perft_table = calloc(perft_mask + 1, sizeof(perftentry));
+        if (perft_table == NULL)
+        {
+            printf("perft hash table allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        printf("perft hash table with %" PRIu64 " entries, size=%" PRIu64
+               "MiB\n", perft_mask + 1,
+               ((perft_mask + 1)*sizeof(perftentry)) >> 20);
+    }
+    work = malloc(128*128*sizeof(perftwork));
+    if (work == NULL)
+    {
+        printf("work list allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
 
     for (d = 1; d <= dmax; d++)
     {
         gettimeofday(&tv1, NULL);
-        nodes = perft(&brd, d);
+        if (nthreads > 1 || divide)
+        {
+            nodes = perft_root(&brd, d, nthreads, &list, &longnot,
+                               rootnodes);
+        }
+        else
+        {
+            nodes = perft(&brd, d);
+        }
         gettimeofday(&tv2, NULL);
         interval = tv2.tv_sec - tv1.tv_sec +
             (tv2.tv_usec - tv1.tv_usec)/1000000.0;
-        printf("perft(%d) %" PRIu64 " nodes, %.2f sec, %.0f kN/s, %s\n",
+        if (divide && d == dmax)
+        {
+            for (i = 0; i < list.count; i++)
+            {
+                print_move_long(&list, i);
+                printf("%" PRIu64 "\n", rootnodes[i]);
+            }
+        }
+        printf("perft(%d) %" PRIu64 " nodes, %.3f sec, %.0f kN/s, %s\n",
                d, nodes, interval, nodes/(1000.0*interval),
                (bulk_counting)?"bulk":"nobulk");
     }
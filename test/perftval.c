@@ -27,7 +27,6 @@
 
 bool debug_info;               /* print extra debug info */
 char db_dirs[PATH_MAX] = ".";  /* directory/ies of database files */
-u64 eval_count;
 
 /* build a tree in the perft-manner and evaluate the nodes */
 /* bb -> current board */
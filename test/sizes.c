@@ -39,8 +39,11 @@ int main(int argc, char *argv[])
     printf("sizeof(long long)=%u\n", (u32) sizeof(long long));
     printf("sizeof(bitboard)=%u\n", (u32) sizeof(bitboard));
     printf("sizeof(movelist)=%u\n", (u32) sizeof(movelist));
+    printf("sizeof(cmove)=%u\n", (u32) sizeof(cmove));
+    printf("sizeof(cmovelist)=%u\n", (u32) sizeof(cmovelist));
     printf("sizeof(lnlist)=%u\n", (u32) sizeof(lnlist));
-    printf("sizeof(ttentry)=%u\n", (u32) sizeof(ttentry));
+    printf("sizeof(ttbucket)=%u\n", (u32) sizeof(ttbucket));
+    printf("sizeof(ttheader)=%u\n", (u32) sizeof(ttheader));
     printf("sizeof(featentry)=%u\n", (u32) sizeof(featentry));
     printf("sizeof feat=%u\n", (u32) sizeof feat);
     printf("sizeof(endhf)=%u\n", (u32) sizeof(endhf));
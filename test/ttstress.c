@@ -0,0 +1,215 @@
+/*
+    Copyright 2015 Harm Jetten
+
+    This file is part of Moby Dam.
+
+    Moby Dam is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Moby Dam is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Moby Dam.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* ttstress.c: transposition table concurrency stress test */
+
+#include "test.h"
+
+#define MAXTHRD 64
+#define NPOS 8192                 /* nr. of positions in the pool */
+#define MOVEBITS ((1ULL << 54) - 1)
+
+typedef struct {                  /* work and results per thread */
+    thrd handle;
+    u32 seed;
+    u64 probes;
+    u64 hits;
+    u64 stores;
+    u64 corrupt;
+} stressthrd;
+
+bool debug_info = FALSE;
+bitboard pool[NPOS];              /* the positions hammered on */
+u64 iterations = 10000000;        /* nr. of tt operations per thread */
+
+/* simple pseudo-random number generator (xorshift) */
+/* seedptr -> generator state */
+/* returns: next pseudo-random number */
+static u32 next_rand(u32 *seedptr)
+{
+    u32 x = *seedptr;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *seedptr = x;
+    return x;
+}
+
+/* the score that is always stored for a pool position */
+/* n = index in pool */
+/* returns: expected score */
+static s32 pool_score(int n)
+{
+    return (s32)((n*2654435761U) % 20000) - 10000;
+}
+
+/* the best move that is always stored for a pool position */
+/* n = index in pool */
+/* returns: expected best move, as from/to pair with capture hash */
+static int pool_move(int n)
+{
+    return (1 + (n*40503U) % TTMOVEMASK) |
+           (((n >> 3) & TTCAPTMASK) << TTCAPTSHIFT);
+}
+
+/* fill the pool with random positions */
+static void fill_pool(void)
+{
+    u32 seed = 2463534242U;
+    u64 w, b;
+    int n;
+
+    for (n = 0; n < NPOS; n++)
+    {
+        w = ((u64)next_rand(&seed) << 32 | next_rand(&seed)) & MOVEBITS;
+        b = ((u64)next_rand(&seed) << 32 | next_rand(&seed)) & MOVEBITS & ~w;
+        pool[n].white = w;
+        pool[n].black = b;
+        pool[n].kings = (w | b) & ((u64)next_rand(&seed) << 22);
+        pool[n].side = n & 1;
+        pool[n].parent = NULL;
+        hash_board(&pool[n]);
+    }
+}
+
+/* thread main function */
+/* mixes stores and probes of random pool positions, and checks */
+/* that every probe hit returns the data stored for that position */
+/* arg -> thread work and results */
+/* returns: NULL */
+static void *stress(void *arg)
+{
+    stressthrd *sp = (stressthrd *) arg;
+    u64 i;
+    s32 score;
+    int n, bestmove;
+
+    for (i = 0; i < iterations; i++)
+    {
+        n = next_rand(&sp->seed) % NPOS;
+        if (i & 1)
+        {
+            store_tt(&pool[n], 0, 1 + n%30, -INFIN, INFIN, pool_score(n),
+                     pool_move(n));
+            sp->stores++;
+        }
+        else
+        {
+            sp->probes++;
+            bestmove = 0;
+            if (probe_tt(&pool[n], 0, 0, -INFIN, INFIN, &score, &bestmove))
+            {
+                sp->hits++;
+                if (score != pool_score(n) || bestmove != pool_move(n))
+                {
+                    sp->corrupt++;
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+/* the program entry point */
+int main(int argc, char *argv[])
+{
+    stressthrd thr[MAXTHRD];
+    int opt, t, nthreads = 4;
+    u32 exp = 12;
+    char *shm_name = NULL;
+    u64 probes, hits, stores, corrupt;
+    struct timeval tv1, tv2;
+    double interval;
+
+    while (TRUE)
+    {
+        opt = getopt(argc, argv, "j:n:t:S:");
+        if (opt == -1)
+        {
+            break;
+        }
+        switch (opt)
+        {
+        case 'j':
+            nthreads = atoi(optarg);
+            break;
+        case 'n':
+            iterations = strtoull(optarg, NULL, 10);
+            break;
+        case 't':
+            exp = atoi(optarg);
+            break;
+        case 'S':
+            shm_name = optarg;
+            break;
+        default:
+            printf("Usage: %s [-j threads] [-n count] [-t exp] [-S ttshm]\n",
+                   argv[0]);
+            printf("  -j threads = nr. of threads, 1..%d (default is 4)\n"
+                   "  -n count = tt operations per thread (default is 1e7)\n"
+                   "  -t exp = exponent of tt size, 10..30 (default is 12)\n"
+                   "  -S ttshm = use tt in named shared memory, to stress it\n"
+                   "       from multiple processes (default is private)\n",
+                   MAXTHRD);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (nthreads < 1 || nthreads > MAXTHRD || exp < 10 || exp > 30)
+    {
+        printf("option out of range\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (!init_tt(exp, nthreads, FALSE, shm_name, shm_name != NULL))
+    {
+        printf("tt memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    fill_pool();
+
+    gettimeofday(&tv1, NULL);
+    memset(thr, 0, sizeof thr);
+    for (t = 0; t < nthreads; t++)
+    {
+        thr[t].seed = 0x9e3779b9U*(t + 1);
+        if (!start_thread(&thr[t].handle, stress, &thr[t]))
+        {
+            printf("can't start thread %d\n", t);
+            exit(EXIT_FAILURE);
+        }
+    }
+    probes = hits = stores = corrupt = 0;
+    for (t = 0; t < nthreads; t++)
+    {
+        join_thread(thr[t].handle);
+        probes += thr[t].probes;
+        hits += thr[t].hits;
+        stores += thr[t].stores;
+        corrupt += thr[t].corrupt;
+    }
+    gettimeofday(&tv2, NULL);
+    interval = tv2.tv_sec - tv1.tv_sec +
+        (tv2.tv_usec - tv1.tv_usec)/1000000.0;
+
+    printf("threads=%d stores=%" PRIu64 " probes=%" PRIu64 " hits=%" PRIu64
+           " corrupted=%" PRIu64 ", %.2f sec\n",
+           nthreads, stores, probes, hits, corrupt, interval);
+    return (corrupt == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}